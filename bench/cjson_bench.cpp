@@ -0,0 +1,762 @@
+/*
+-----------------------------------------------------------------
+ cjson benchmarks - Copyright 2015, Seth A. Hamilton
+
+ build from the cjson directory with HeapStack checked out next
+ to it (cjson.h includes ../heapstack/heapstack.h), i.e.
+
+   g++ -O2 -std=c++11 -pthread -D__forceinline=inline bench/cjson_bench.cpp cjson.cpp -o cjson_bench
+
+ (-D__forceinline=inline is for compilers other than MSVC)
+
+ each benchmark prints one line: name, iterations, average ms 
+ and throughput in MB/s of the input it works on. Each corpus 
+ starts with it's size, node count and HeapStack bytes per node.
+
+ The corpora are generated from fixed seeds, so every run (and 
+ every machine) benchmarks exactly the same JSON:
+
+   wide     one object with many keys
+   deep     records nested 64 levels deep
+   numbers  an array of integers and doubles
+   text     string heavy records
+   escaped  strings full of escapes and UTF-8
+   logs     NDJSON log lines, parsed one line at a time
+   records  an array of records with mixed value types, used by
+            the feature benchmarks that follow it
+
+   cjson_bench --json
+
+ prints every result as one JSON document instead, to be kept
+ as a baseline and compared against later runs.
+ -----------------------------------------------------------------
+*/
+
+#include "../cjson.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+struct Result
+{
+	std::string corpus;
+	std::string name;
+	int iterations;
+	double ms;
+	size_t bytes;
+};
+
+struct Corpus
+{
+	std::string name;
+	size_t bytes;
+	cjson::DocumentStats stats;
+};
+
+std::vector< Result > results;
+std::vector< Corpus > corpora;
+bool jsonOutput = false;
+
+// lines for people, left out of --json output
+template <typename... Args>
+void note(const char* Format, Args... args)
+{
+	if (!jsonOutput)
+		printf(Format, args...);
+}
+
+// run Test Iterations times and report the average, Bytes is the 
+// input it works on (0 if throughput doesn't apply)
+template <typename Test>
+void bench(const char* Name, int Iterations, size_t Bytes, Test test)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < Iterations; i++)
+		test();
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Iterations;
+
+	results.push_back({ corpora.back().name, Name, Iterations, ms, Bytes });
+
+	if (Bytes)
+		note("%-24s %6d %10.3f ms %10.1f MB/s\n", Name, Iterations, ms, (Bytes / 1048576.0) / (ms / 1000.0));
+	else
+		note("%-24s %6d %10.3f ms\n", Name, Iterations, ms);
+}
+
+// start a corpus, Nodes are the nodes parsed from it's Bytes of JSON
+void corpus(const char* Name, size_t Bytes, const cjson::DocumentStats& Stats)
+{
+	corpora.push_back({ Name, Bytes, Stats });
+
+	note("\n%s: %zu bytes, %zu nodes, %.1f HeapStack bytes per node\n", 
+		Name, Bytes, Stats.nodes, (double)Stats.arenaBytes / Stats.nodes);
+}
+
+/*
+  corpus generators
+*/
+
+// xorshift64, the same sequence on every platform (std distributions 
+// are implementation defined)
+struct Random
+{
+	uint64_t state;
+
+	Random(uint64_t Seed) : state(Seed) {}
+
+	uint64_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	// Low to High inclusive
+	int64_t range(int64_t Low, int64_t High)
+	{
+		return Low + (int64_t)(next() % (uint64_t)(High - Low + 1));
+	}
+};
+
+static const char* words[] = { 
+	"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", 
+	"sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", 
+	"magna", "aliqua", "enim", "ad", "minim", "veniam", "quis", "nostrud", 
+	"exercitation", "ullamco", "laboris", "nisi", "aliquip", "ex", "ea", "commodo" };
+
+std::string sentence(Random& random, int Words)
+{
+	std::string text;
+
+	for (int i = 0; i < Words; i++)
+	{
+		if (i)
+			text += " ";
+		text += words[random.next() % (sizeof(words) / sizeof(words[0]))];
+	}
+
+	return text;
+}
+
+std::string number(Random& random)
+{
+	char buffer[32];
+
+	switch (random.next() % 4)
+	{
+	case 0:
+		snprintf(buffer, sizeof(buffer), "%lld", (long long)random.range(-1000, 1000));
+		break;
+	case 1:
+		snprintf(buffer, sizeof(buffer), "%lld", (long long)(random.next() >> 1));
+		break;
+	case 2:
+		snprintf(buffer, sizeof(buffer), "%.6f", random.range(-1000000, 1000000) / 1000.0);
+		break;
+	default:
+		snprintf(buffer, sizeof(buffer), "%.15g", (random.next() >> 11) * 1e-300 * (double)(1ull << (random.next() % 60)));
+		break;
+	}
+
+	return buffer;
+}
+
+// one object with Keys keys and values of every type
+std::string makeWide(int Keys)
+{
+	Random random(1);
+	std::string json = "{";
+
+	for (int i = 0; i < Keys; i++)
+	{
+		if (i)
+			json += ",";
+
+		json += "\"key " + std::to_string(i) + "\":";
+
+		switch (i % 5)
+		{
+		case 0: json += number(random); break;
+		case 1: json += "\"" + sentence(random, 2) + "\""; break;
+		case 2: json += (random.next() & 1) ? "true" : "false"; break;
+		case 3: json += "null"; break;
+		default: json += "[" + number(random) + "," + number(random) + "]"; break;
+		}
+	}
+
+	return json + "}";
+}
+
+// Count records, each nested Depth levels deep through "next"
+std::string makeDeep(int Count, int Depth)
+{
+	Random random(2);
+	std::string json = "[";
+
+	for (int i = 0; i < Count; i++)
+	{
+		if (i)
+			json += ",";
+
+		for (int level = 0; level < Depth; level++)
+			json += "{\"level\":" + std::to_string(level) + ",\"id\":" + number(random) + ",\"next\":[";
+
+		json += "null";
+
+		for (int level = 0; level < Depth; level++)
+			json += "]}";
+	}
+
+	return json + "]";
+}
+
+std::string makeNumbers(int Count)
+{
+	Random random(3);
+	std::string json = "[";
+
+	for (int i = 0; i < Count; i++)
+	{
+		if (i)
+			json += ",";
+		json += number(random);
+	}
+
+	return json + "]";
+}
+
+std::string makeText(int Count)
+{
+	Random random(4);
+	std::string json = "[";
+
+	for (int i = 0; i < Count; i++)
+	{
+		if (i)
+			json += ",";
+
+		json += "{\"id\":" + std::to_string(i) + 
+			",\"title\":\"" + sentence(random, 6) + "\"" +
+			",\"author\":\"" + sentence(random, 2) + "\"" +
+			",\"body\":\"" + sentence(random, (int)random.range(20, 120)) + "\"" +
+			",\"tags\":[\"" + sentence(random, 1) + "\",\"" + sentence(random, 1) + "\"]}";
+	}
+
+	return json + "]";
+}
+
+// strings mixing plain text, escapes, \u escapes (with surrogate 
+// pairs) and raw UTF-8
+std::string makeEscaped(int Count)
+{
+	static const char* pieces[] = {
+		"plain text ", "\\\"quoted\\\" ", "back\\\\slash ", "line\\nbreak ", "tab\\tstop ",
+		"caf\\u00e9 ", "\\u65e5\\u672c ", "smile \\ud83d\\ude00 ", "\\/path\\/to ",
+		"h\xc3\xa9llo w\xc3\xb6rld ", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e ", "\xf0\x9f\x98\x80 ", "\\r\\b\\f " };
+
+	Random random(5);
+	std::string json = "[";
+
+	for (int i = 0; i < Count; i++)
+	{
+		if (i)
+			json += ",";
+
+		json += "\"";
+
+		for (int piece = (int)random.range(2, 8); piece; piece--)
+			json += pieces[random.next() % (sizeof(pieces) / sizeof(pieces[0]))];
+
+		json += "\"";
+	}
+
+	return json + "]";
+}
+
+// NDJSON, one log record per line
+std::string makeLogs(int Lines)
+{
+	static const char* levels[] = { "debug", "info", "info", "info", "warn", "error" };
+	static const char* methods[] = { "GET", "GET", "GET", "POST", "PUT", "DELETE" };
+
+	Random random(6);
+	std::string ndjson;
+	char buffer[64];
+
+	for (int i = 0; i < Lines; i++)
+	{
+		snprintf(buffer, sizeof(buffer), "2015-06-%02d %02d:%02d:%02d.%03d", 
+			(int)random.range(1, 30), (int)random.range(0, 23), (int)random.range(0, 59), 
+			(int)random.range(0, 59), (int)random.range(0, 999));
+
+		ndjson += "{\"time\":\"" + std::string(buffer) + "\"" +
+			",\"level\":\"" + levels[random.next() % 6] + "\"" +
+			",\"method\":\"" + methods[random.next() % 6] + "\"" +
+			",\"path\":\"/v1/items/" + std::to_string(random.range(1, 100000)) + "\"" +
+			",\"status\":" + std::to_string((random.next() % 10) ? 200 : 500) +
+			",\"latency\":" + std::to_string(random.range(1, 250000) / 1000.0) +
+			",\"user\":{\"id\":" + std::to_string(random.range(1, 5000)) + ",\"agent\":\"" + sentence(random, 3) + "\"}" +
+			",\"message\":\"" + sentence(random, (int)random.range(3, 15)) + "\"}\n";
+	}
+
+	return ndjson;
+}
+
+// Parse, Stringify, xPath, find and at on one document corpus. Path 
+// is looked up by xPath, find and at use a sample of the top level 
+// keys or indexes (walking the member list for each is quadratic)
+void corpusSuite(const char* Name, const std::string& JSON, const char* Path)
+{
+	cjson* doc = cjson::Parse(JSON);
+	corpus(Name, JSON.length(), cjson::Stats(doc));
+
+	bench("Parse", 10, JSON.length(), [&]() {
+		cjson::DisposeDocument(cjson::Parse(JSON.c_str(), JSON.length()));
+	});
+
+	bench("Stringify", 10, JSON.length(), [&]() {
+		cjson::Stringify(doc);
+	});
+
+	cjson* frozen = cjson::Freeze(cjson::Parse(JSON));
+
+	auto lookup = [&](cjson* Doc) {
+		for (int i = 0; i < 100; i++)
+			Doc->xPath(std::string(Path));
+	};
+
+	bench("xPath (x100)", 10, 0, [&]() { lookup(doc); });
+	bench("xPath (x100, frozen)", 10, 0, [&]() { lookup(frozen); });
+
+	int size = doc->size();
+	int step = (size > 100) ? size / 100 : 1;
+
+	if (doc->type() == cjsonType::OBJECT)
+	{
+		std::vector< std::string > keys = doc->getKeys();
+
+		auto findKeys = [&](cjson* Doc) {
+			for (int i = 0; i < size; i += step)
+				Doc->find(keys[i]);
+		};
+
+		bench("find (x100)", 10, 0, [&]() { findKeys(doc); });
+		bench("find (x100, frozen)", 10, 0, [&]() { findKeys(frozen); });
+	}
+	else
+	{
+		auto atIndexes = [&](cjson* Doc) {
+			for (int i = 0; i < size; i += step)
+				Doc->at(i);
+		};
+
+		bench("at (x100)", 10, 0, [&]() { atIndexes(doc); });
+		bench("at (x100, frozen)", 10, 0, [&]() { atIndexes(frozen); });
+	}
+
+	cjson::DisposeDocument(frozen);
+	cjson::DisposeDocument(doc);
+}
+
+// NDJSON is parsed and written one line (document) at a time
+void logsSuite(const std::string& NDJSON)
+{
+	std::vector< std::pair< const char*, size_t > > lines;
+
+	for (const char* line = NDJSON.c_str(); *line; )
+	{
+		const char* end = strchr(line, '\n');
+		lines.emplace_back(line, end - line);
+		line = end + 1;
+	}
+
+	std::vector< cjson* > docs;
+	cjson::DocumentStats total;
+	memset(&total, 0, sizeof(total));
+
+	for (auto& line : lines)
+	{
+		docs.push_back(cjson::Parse(line.first, line.second));
+
+		cjson::DocumentStats stats = cjson::Stats(docs.back());
+		total.nodes += stats.nodes;
+		total.arenaBytes += stats.arenaBytes;
+	}
+
+	corpus("logs", NDJSON.length(), total);
+
+	bench("Parse", 10, NDJSON.length(), [&]() {
+		for (auto& line : lines)
+			cjson::DisposeDocument(cjson::Parse(line.first, line.second));
+	});
+
+	bench("Stringify", 10, NDJSON.length(), [&]() {
+		for (cjson* doc : docs)
+			cjson::Stringify(doc);
+	});
+
+	bench("xPath", 10, 0, [&]() {
+		for (cjson* doc : docs)
+			doc->xPath(std::string("user/id"));
+	});
+
+	bench("find", 10, 0, [&]() {
+		for (cjson* doc : docs)
+			doc->find("message");
+	});
+
+	for (cjson* doc : docs)
+		cjson::DisposeDocument(doc);
+}
+
+void stdoutSink(void* Context, const char* Data, size_t Length)
+{
+	fwrite(Data, 1, Length, stdout);
+}
+
+// --json output
+void writeResults()
+{
+	cjson::Writer writer(stdoutSink, NULL, cjson::StringifyOptions(2));
+
+	writer.beginObject();
+
+#if defined(__clang__) || defined(__GNUC__)
+	writer.key("compiler");
+	writer.value(__VERSION__);
+#elif defined(_MSC_VER)
+	writer.key("compiler");
+	writer.value("msvc " + std::to_string(_MSC_VER));
+#endif
+
+#ifdef CJSON_INSTRUMENT
+	writer.key("instrumented");
+	writer.value(true);
+#else
+	writer.key("instrumented");
+	writer.value(false);
+#endif
+
+	writer.key("cores");
+	writer.value((int)std::thread::hardware_concurrency());
+
+	writer.key("corpora");
+	writer.beginArray();
+
+	for (auto& corpus : corpora)
+	{
+		writer.beginObject();
+		writer.key("name");
+		writer.value(corpus.name);
+		writer.key("bytes");
+		writer.value((int64_t)corpus.bytes);
+		writer.key("nodes");
+		writer.value((int64_t)corpus.stats.nodes);
+		writer.key("heapBytes");
+		writer.value((int64_t)corpus.stats.arenaBytes);
+		writer.key("bytesPerNode");
+		writer.value((double)corpus.stats.arenaBytes / corpus.stats.nodes);
+		writer.endObject();
+	}
+
+	writer.endArray();
+
+	writer.key("results");
+	writer.beginArray();
+
+	for (auto& result : results)
+	{
+		writer.beginObject();
+		writer.key("corpus");
+		writer.value(result.corpus);
+		writer.key("name");
+		writer.value(result.name);
+		writer.key("iterations");
+		writer.value(result.iterations);
+		writer.key("ms");
+		writer.value(result.ms);
+
+		if (result.bytes)
+		{
+			writer.key("MBs");
+			writer.value((result.bytes / 1048576.0) / (result.ms / 1000.0));
+		}
+
+		writer.endObject();
+	}
+
+	writer.endArray();
+	writer.endObject();
+	writer.flush();
+
+	printf("\n");
+}
+
+// the records below as structs, for ParseInto
+struct Position
+{
+	int64_t x = 0;
+	int64_t y = 0;
+};
+
+struct Record
+{
+	int64_t id = 0;
+	std::string name;
+	double price = 0;
+	bool active = false;
+	std::vector< std::string > tags;
+	Position position;
+};
+
+CJSON_BIND(Position, CJSON_FIELD(x), CJSON_FIELD(y))
+CJSON_BIND(Record,
+	CJSON_FIELD(id),
+	CJSON_FIELD(name),
+	CJSON_FIELD(price),
+	CJSON_FIELD(active),
+	CJSON_FIELD(tags),
+	CJSON_FIELD(position))
+
+// an array of records with mixed value types
+std::string makeRecords(int Count)
+{
+	std::string json = "[";
+
+	for (int i = 0; i < Count; i++)
+	{
+		if (i)
+			json += ",";
+
+		json += "{\"id\":" + std::to_string(i) + 
+			",\"name\":\"record " + std::to_string(i) + "\"" +
+			",\"price\":" + std::to_string(i * 1.25) +
+			",\"active\":" + ((i & 1) ? "true" : "false") +
+			",\"tags\":[\"alpha\",\"beta\",\"gamma\"]" +
+			",\"position\":{\"x\":" + std::to_string(i % 100) + ",\"y\":" + std::to_string(i / 100) + "}}";
+	}
+
+	return json + "]";
+}
+
+int main(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--json") == 0)
+			jsonOutput = true;
+
+	corpusSuite("wide", makeWide(100000), "key 99999");
+	corpusSuite("deep", makeDeep(1000, 64), "999/next/0/next/0/next/0/next/0/id");
+	corpusSuite("numbers", makeNumbers(500000), "499999");
+	corpusSuite("text", makeText(10000), "9999/body");
+	corpusSuite("escaped", makeEscaped(100000), "99999");
+	logsSuite(makeLogs(50000));
+
+	std::string json = makeRecords(100000);
+	cjson* doc = cjson::Parse(json);
+	std::string binary = cjson::ToBinary(doc);
+	std::string binaryNoKeys = cjson::ToBinary(doc, false);
+
+	corpus("records", json.length(), cjson::Stats(doc));
+
+	note("binary %zu bytes (%zu without key dictionary)\n", binary.length(), binaryNoKeys.length());
+
+	bench("Parse", 10, json.length(), [&]() {
+		cjson::DisposeDocument(cjson::Parse(json.c_str(), json.length()));
+	});
+
+	bench("FromBinary", 10, binary.length(), [&]() {
+		cjson::DisposeDocument(cjson::FromBinary(binary.c_str(), binary.length()));
+	});
+
+	bench("FromBinary (no keys)", 10, binaryNoKeys.length(), [&]() {
+		cjson::DisposeDocument(cjson::FromBinary(binaryNoKeys.c_str(), binaryNoKeys.length()));
+	});
+
+	bench("ToBinary", 10, binary.length(), [&]() {
+		cjson::ToBinary(doc);
+	});
+
+	bench("Stringify", 10, json.length(), [&]() {
+		cjson::Stringify(doc);
+	});
+
+	// pretty output is about twice as long, so both are measured per 
+	// byte written to compare the cost of formatting
+	double compactNs = results.back().ms * 1e6 / json.length();
+	cjson::StringifyOptions pretty(2);
+	size_t prettyLength = cjson::Stringify(doc, pretty).length();
+
+	bench("Stringify (pretty)", 10, prettyLength, [&]() {
+		cjson::Stringify(doc, pretty);
+	});
+
+	double prettyNs = results.back().ms * 1e6 / prettyLength;
+
+	note("pretty %zu bytes, %.2f ns/byte against %.2f ns/byte compact (%+.0f%%)\n", 
+		prettyLength, prettyNs, compactNs, (prettyNs / compactNs - 1) * 100);
+
+	// one field changed between each Stringify
+	cjson::StringifyOptions cached;
+	cached.cache = true;
+	cjson::Stringify(doc, cached);
+	int64_t change = 0;
+
+	bench("Stringify (cache)", 10, json.length(), [&]() {
+		doc->at((int)(change % 100000))->set("id", change);
+		++change;
+		cjson::Stringify(doc, cached);
+	});
+
+	bench("Clone", 10, json.length(), [&]() {
+		cjson* target = cjson::MakeDocument();
+		cjson::Clone(doc, target);
+		cjson::DisposeDocument(target);
+	});
+
+	bench("Stats", 10, json.length(), [&]() {
+		cjson::Stats(doc);
+	});
+
+	bench("Clone (Stringify+Parse)", 10, json.length(), [&]() {
+		cjson::DisposeDocument(cjson::Parse(cjson::Stringify(doc)));
+	});
+
+	cjson* schemaDoc = cjson::Parse(
+		"{\"type\":\"array\",\"items\":{\"type\":\"object\",\"required\":[\"id\",\"name\",\"position\"],"
+		"\"additionalProperties\":false,\"properties\":{"
+		"\"id\":{\"type\":\"integer\",\"minimum\":0},"
+		"\"name\":{\"type\":\"string\",\"minLength\":1,\"maxLength\":64},"
+		"\"price\":{\"type\":\"number\",\"minimum\":0},"
+		"\"active\":{\"type\":\"boolean\"},"
+		"\"tags\":{\"type\":\"array\",\"items\":{\"enum\":[\"alpha\",\"beta\",\"gamma\"]}},"
+		"\"position\":{\"type\":\"object\",\"properties\":{\"x\":{\"type\":\"integer\"},\"y\":{\"type\":\"integer\"}}}}}}");
+	cjson::Schema* schema = cjson::Schema::Compile(schemaDoc);
+
+	bench("Schema (node)", 10, json.length(), [&]() {
+		schema->validate(doc);
+	});
+
+	bench("Schema (JSON)", 10, json.length(), [&]() {
+		schema->validate(json.c_str(), json.length());
+	});
+
+	bench("Schema (parse)", 10, json.length(), [&]() {
+		cjson::DisposeDocument(schema->parse(json.c_str(), json.length()));
+	});
+
+	delete schema;
+	cjson::DisposeDocument(schemaDoc);
+
+	cjson::Query* expensive = cjson::Query::Compile("/*[?price > 100000]/name");
+	cjson::Query* positions = cjson::Query::Compile("//position/x");
+
+	cjson::Query::Callback each = [](void* Context, cjson* Node) { return true; };
+
+	bench("Query (filter)", 10, json.length(), [&]() {
+		expensive->run(doc, each, NULL);
+	});
+
+	bench("Query (descent)", 10, json.length(), [&]() {
+		positions->run(doc, each, NULL);
+	});
+
+	delete expensive;
+	delete positions;
+
+	std::vector< cjson::Column > columns = {
+		cjson::Column("id", cjsonType::INT),
+		cjson::Column("price", cjsonType::DBL),
+		cjson::Column("name", cjsonType::STR) };
+
+	bench("ExtractColumns", 10, json.length(), [&]() {
+		cjson::ExtractColumns(doc, columns);
+	});
+
+	bench("ExtractColumns (xPath)", 10, json.length(), [&]() {
+		std::vector< int64_t > ids;
+		std::vector< double > prices;
+		std::vector< std::string > names;
+
+		for (cjson* row : doc->getNodes())
+		{
+			ids.push_back(row->xPath(std::string("id"), (int64_t)0));
+			prices.push_back(row->xPath(std::string("price"), 0.0));
+			names.push_back(row->xPath(std::string("name"), std::string()));
+		}
+	});
+
+	// scaling with threads, see StringifyOptions::threads
+	for (int threads = 2; threads <= 8; threads *= 2)
+	{
+		cjson::StringifyOptions options;
+		options.threads = threads;
+
+		std::string name = "Stringify (" + std::to_string(threads) + " threads)";
+
+		bench(name.c_str(), 10, json.length(), [&]() {
+			cjson::Stringify(doc, options);
+		});
+	}
+
+	for (int threads = 1; threads <= 8; threads *= 2)
+	{
+		std::string name = "ParallelForEach (" + std::to_string(threads) + ")";
+
+		bench(name.c_str(), 10, json.length(), [&]() {
+			cjson::ParallelForEach(doc, [](cjson* Record, size_t Index) {
+				cjson::Stringify(Record);
+			}, threads);
+		});
+	}
+
+	// lookups on the linked lists against a frozen copy, at walks the
+	// list so only every 1000th record is visited
+	cjson* frozen = cjson::Freeze(cjson::Parse(json));
+
+	cjson* wide = cjson::MakeDocument();
+
+	for (int i = 0; i < 10000; i++)
+		wide->set("key " + std::to_string(i), (int64_t)i);
+
+	cjson* wideFrozen = cjson::Freeze(cjson::Parse(cjson::Stringify(wide)));
+
+	auto visitRecords = [](cjson* Doc) {
+		for (int i = 0; i < 100000; i += 1000)
+			Doc->at(i)->find("position")->find("y");
+	};
+
+	auto findKeys = [](cjson* Doc) {
+		for (int i = 0; i < 10000; i++)
+			Doc->find("key " + std::to_string(i));
+	};
+
+	bench("at+find", 10, 0, [&]() { visitRecords(doc); });
+	bench("at+find (frozen)", 10, 0, [&]() { visitRecords(frozen); });
+	bench("find wide", 10, 0, [&]() { findKeys(wide); });
+	bench("find wide (frozen)", 10, 0, [&]() { findKeys(wideFrozen); });
+
+	cjson::DisposeDocument(frozen);
+	cjson::DisposeDocument(wide);
+	cjson::DisposeDocument(wideFrozen);
+
+	std::vector< Record > records;
+
+	bench("ParseInto", 10, json.length(), [&]() {
+		cjson::ParseInto(json, records);
+	});
+
+	bench("StringifyFrom", 10, json.length(), [&]() {
+		cjson::StringifyFrom(records);
+	});
+
+	cjson::DisposeDocument(doc);
+
+	if (jsonOutput)
+		writeResults();
+
+	return 0;
+}
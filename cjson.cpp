@@ -9,6 +9,35 @@
 #include "cjson.h"
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include <regex>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CJSON_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 	
 // Split - an std::string split function. 
 // some of these should just be part of the stl by now.
@@ -57,267 +86,511 @@ void Split(std::string Source, char Token, std::vector< std::string > &result )
 
 }
 
-// SkipJunk - helper function for document parser. Skips spaces, line breaks, etc.
-// updates cursor as a reference.
-void SkipJunk(char* &cursor)
+// FirstBit - index of the lowest set bit in a (non zero) mask
+// used by the SIMD scanners below.
+__forceinline int FirstBit(unsigned int mask)
 {
-	while (*cursor == ' ' ||
-		*cursor == '\r' ||
-		*cursor == '\n' ||
-		*cursor == '\t')
-		++cursor;
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
 }
 
-// ParseNumeric - helper function to advance cursor past number
-// and return number as std::string
-__inline std::string ParseNumeric( char* &cursor, bool &isDouble )
+// Utf8Length - helper for ScanQuote. Checks the multi-byte UTF-8 
+// sequence at cursor. Returns it's length, 0 if it is invalid (bad lead
+// byte, bad continuation, overlong, surrogate or > U+10FFFF) or -1
+// if the sequence is cut off by end.
+__forceinline int Utf8Length(const unsigned char* cursor, const unsigned char* end)
 {
+	unsigned char lead = *cursor;
+	unsigned char low = 0x80;  // range for the second byte
+	unsigned char high = 0xBF;
+	int length;
+
+	if (lead >= 0xC2 && lead <= 0xDF)
+		length = 2;
+	else if (lead >= 0xE0 && lead <= 0xEF)
+	{
+		length = 3;
+		if (lead == 0xE0)
+			low = 0xA0;  // overlong
+		else if (lead == 0xED)
+			high = 0x9F; // surrogates
+	}
+	else if (lead >= 0xF0 && lead <= 0xF4)
+	{
+		length = 4;
+		if (lead == 0xF0)
+			low = 0x90;  // overlong
+		else if (lead == 0xF4)
+			high = 0x8F; // > U+10FFFF
+	}
+	else
+		return 0;
 
-	char* cursorStart = cursor;
+	for (int i = 1; i < length; i++)
+	{
+		if (cursor + i >= end)
+			return -1;
 
-	isDouble = false;
+		unsigned char c = cursor[i];
 
-	// is a number, decimal and possibliy negagive
-	while (*cursor >= '-' && *cursor <= '9')
-	{
-		if (*cursor == '.')
-			isDouble = true;
-		cursor++;
+		if (i == 1)
+		{
+			if (c < low || c > high)
+				return 0;
+		}
+		else if (c < 0x80 || c > 0xBF)
+			return 0;
 	}
 
-	return std::string(cursorStart, cursor - cursorStart);
-
+	return length;
 }
 
-cjson* cjson::ParseBranch( cjson* N, char* &cursor )
+// ScanQuote - helper function for Reader. Returns the position 
+// of the closing quote of a string, or of a control character (which
+// must be escaped in JSON) or end if the string is not terminated.
+// Escaped characters are skipped over and Escaped is set if there are any.
+//
+// When SSE2 is available runs of clean characters are tested 16 bytes
+// at a time. The vector loop only runs while 16 bytes remain in the input
+// so it never reads past end and the input requires no padding.
+//
+// When Validate is set UTF-8 is checked in the same pass. Bytes with the
+// high bit set are added to the vector stop mask, so pure ASCII runs
+// cost nothing extra, and each multi-byte sequence is checked where it
+// is found. The position of an invalid sequence is returned.
+const char* cjson::ScanQuote(const char* cursor, const char* end, bool &Escaped, bool Validate)
 {
+#ifdef CJSON_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i slash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+#endif
 
-	if (!*cursor)
-		return cjson::MakeDocument();
+	Escaped = false;
 
-	if (N == NULL)
+	while (cursor < end)
 	{
-		SkipJunk( cursor );
-
-		if (*cursor != '[' && *cursor != '{')
+#ifdef CJSON_SSE2
+		while (end - cursor >= 16)
 		{
-			return cjson::MakeDocument();
+			__m128i chunk = _mm_loadu_si128((const __m128i*)cursor);
+			// max(chunk, 0x1F) == 0x1F finds bytes <= 0x1F
+			unsigned int mask = (unsigned int)_mm_movemask_epi8(
+				_mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, slash)),
+					_mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control)));
+
+			// high bits are the non-ASCII bytes
+			if (Validate)
+				mask |= (unsigned int)_mm_movemask_epi8(chunk);
+
+			if (mask)
+			{
+				cursor += FirstBit(mask);
+				break;
+			}
+
+			cursor += 16;
 		}
 
-		if (*cursor == '{')
+		if (cursor >= end)
+			break;
+#endif
+		if (*cursor == '"' || (unsigned char)*cursor < 0x20)
+			return cursor;
+
+		if (*cursor == '\\')
 		{
-			N = cjson::MakeDocument();
+			if (end - cursor < 2)
+				return end;
+			Escaped = true;
+			cursor++;
 		}
-		else
+		else if (Validate && (unsigned char)*cursor >= 0x80)
 		{
-			N = cjson::MakeDocument();
-			N->setType(cjsonType::ARRAY);
+			int length = Utf8Length((const unsigned char*)cursor, (const unsigned char*)end);
+
+			if (length < 0)
+				return end;
+			if (!length)
+				return cursor;
+
+			cursor += length;
+			continue;
 		}
 
 		cursor++;
 	}
 
-	std::string Name = "";
+	return end;
+}
+
+// Hex4 - helper for Unescape, reads the 4 hex digits of a \u escape
+__forceinline bool Hex4(const char* text, const char* end, uint32_t &code)
+{
+	if (end - text < 4)
+		return false;
 
-	char* start;
-	size_t len;
+	code = 0;
 
-	while (*cursor)
+	for (int i = 0; i < 4; i++)
 	{
-		
-		// this is a number out at the main loop, so we are appending an array probably
+		char c = text[i];
+		code <<= 4;
+
+		if (c >= '0' && c <= '9')
+			code |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			code |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			code |= c - 'A' + 10;
+		else
+			return false;
+	}
 
-		if (*cursor == '}' || *cursor == ']')
-		{
-			cursor++;
-			return N;
-		}
+	return true;
+}
 
-		// this is a docum without a string identifier, or an document in an array likely
-		if (*cursor == '{')
-		{
-			cursor++;
-			cjson* A = N->pushObject();
-			cjson::ParseBranch( A, cursor );
-			//cursor++; // move past closing condition;
-		}
-		// this is an array without a string identifier, or an array in an array likely
-		else if (*cursor == '[')
-		{
-			cursor++;
-			cjson* A = N->pushArray();
-			cjson::ParseBranch( A, cursor );
-			//cursor++; // move past closing condition;
-		}
-		else if (*cursor == '-' || (*cursor >= '0' && *cursor <= '9')) // number or neg number)
+// EncodeUtf8 - helper for Unescape, writes code point as UTF-8
+__forceinline char* EncodeUtf8(char* out, uint32_t code)
+{
+	if (code < 0x80)
+	{
+		*out++ = (char)code;
+	}
+	else if (code < 0x800)
+	{
+		*out++ = (char)(0xC0 | (code >> 6));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	else if (code < 0x10000)
+	{
+		*out++ = (char)(0xE0 | (code >> 12));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	else
+	{
+		*out++ = (char)(0xF0 | (code >> 18));
+		*out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+
+	return out;
+}
+
+// Unescape - decodes JSON escape sequences. \u escapes become UTF-8,
+// surrogate pairs are combined and unpaired surrogates are replaced
+// with U+FFFD. The decoded text is never longer than the source so 
+// Dest needs Length bytes. 
+//
+// With SSE2 clean text is copied 16 bytes at a time until a backslash
+// is found. The 16 byte store is safe because the write position never
+// passes the read position.
+bool cjson::Unescape(const char* Text, size_t Length, char* Dest, size_t &DestLength)
+{
+	const char* end = Text + Length;
+	char* out = Dest;
+	uint32_t code;
+	uint32_t low;
+
+#ifdef CJSON_SSE2
+	const __m128i slash = _mm_set1_epi8('\\');
+#endif
+
+	while (Text < end)
+	{
+#ifdef CJSON_SSE2
+		while (end - Text >= 16)
 		{
-			
-			bool isDouble = false;
-			std::string Value = ParseNumeric( cursor, isDouble );
+			__m128i chunk = _mm_loadu_si128((const __m128i*)Text);
+			_mm_storeu_si128((__m128i*)out, chunk);
 
-			if (isDouble)
-			{
-				char* endp;
-				double D = strtod( Value.c_str(), &endp ); 
-				N->push( D );
-			}
-			else
+			unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, slash));
+
+			if (mask)
 			{
-				char* endp;
-				int64_t LL = strtoll( Value.c_str(), &endp, 10 ); 
-				N->push( LL );
+				int clean = FirstBit(mask);
+				Text += clean;
+				out += clean;
+				break;
 			}
 
+			Text += 16;
+			out += 16;
+		}
+
+		if (Text >= end)
+			break;
+#endif
+		if (*Text != '\\')
+		{
+			*out++ = *Text++;
+			continue;
 		}
-		else if (*cursor == '"')
+
+		if (end - Text < 2)
+			return false;
+
+		switch (Text[1])
 		{
-			cursor++;
+		case '"':
+			*out++ = '"';
+			break;
+		case '\\':
+			*out++ = '\\';
+			break;
+		case '/':
+			*out++ = '/';
+			break;
+		case 'b':
+			*out++ = '\b';
+			break;
+		case 'f':
+			*out++ = '\f';
+			break;
+		case 'n':
+			*out++ = '\n';
+			break;
+		case 'r':
+			*out++ = '\r';
+			break;
+		case 't':
+			*out++ = '\t';
+			break;
+		case 'u':
+			if (!Hex4(Text + 2, end, code))
+				return false;
+
+			Text += 6;
 
-			start = cursor;
-			while (*cursor != 0)
+			if (code >= 0xD800 && code <= 0xDBFF)
 			{
-				if (*cursor == '"')
-					break;
-				if (*cursor == '\\') 
-					cursor++;			
-				cursor++;
+				// high surrogate, should be followed by a low surrogate
+				if (end - Text >= 6 && Text[0] == '\\' && Text[1] == 'u' &&
+					Hex4(Text + 2, end, low) && low >= 0xDC00 && low <= 0xDFFF)
+				{
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					Text += 6;
+				}
+				else
+					code = 0xFFFD;
 			}
+			else if (code >= 0xDC00 && code <= 0xDFFF)
+				code = 0xFFFD;
 
-			len = cursor - start;
-			Name.assign( start, len );
+			out = EncodeUtf8(out, code);
+			continue;
+		default:
+			return false;
+		}
 
-			cursor++;
-					
-			SkipJunk( cursor );
+		Text += 2;
+	}
 
-			// this is a comman right after a string, so we are appending an array of strings
-			if (*cursor == ',' || *cursor == ']') {
-				
-				N->push( Name );
+	DestLength = out - Dest;
+	return true;
+}
 
-			}
-			else
-			if (*cursor == ':') {
-				
-				cursor++;
-				SkipJunk( cursor );
+// ValidEscapes - helper for Reader when strings are not being decoded
+// (Validate), checks each escape sequence without writing anything.
+bool cjson::ValidEscapes(const char* Text, size_t Length)
+{
+	const char* end = Text + Length;
+	uint32_t code;
 
-				// we have a nested document
-				if (*cursor == '{')
-				{
-					cursor++;
+	while ((Text = (const char*)memchr(Text, '\\', end - Text)) != NULL)
+	{
+		if (end - Text < 2)
+			return false;
 
-					cjson* D = N->setObject( Name );
-					cjson::ParseBranch( D, cursor );
-					//cursor++; // move past closing condition;
-					continue;
+		switch (Text[1])
+		{
+		case '"':
+		case '\\':
+		case '/':
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+			Text += 2;
+			break;
+		case 'u':
+			if (!Hex4(Text + 2, end, code))
+				return false;
+			Text += 6;
+			break;
+		default:
+			return false;
+		}
+	}
 
-				}
-				else
-				// we have a nested array
-				if (*cursor == '[')
-				{
-					cursor++;
+	return true;
+}
 
-					cjson* A = N->setArray( Name );
-					cjson::ParseBranch( A, cursor );
-					//cursor++; // move past closing condition;
-					continue;
-				}
-				else
-				if (*cursor == '"')
-				{
-					cursor++;
+// ParseNumber - helper function for Reader. Validates the JSON number 
+// in [start, end) and converts it. Integers are accumulated directly,
+// anything with a fraction, exponent or too many digits for an int64_t
+// goes through strtod.
+int cjson::ParseNumber(const char* start, const char* end, int64_t &Int, double &Dbl, bool Convert)
+{
+	const char* cursor = start;
+	bool negative = false;
+	bool isDouble = false;
+	uint64_t value = 0;
+	int digits = 0;
 
-					start = cursor;
+	if (cursor < end && *cursor == '-')
+	{
+		negative = true;
+		cursor++;
+	}
 
-					while (*cursor != 0)
-					{
-						if (*cursor == '"')
-							break;
+	if (cursor == end || *cursor < '0' || *cursor > '9')
+		return 0;
 
-						if (*cursor == '\\') 
-							cursor++;			
+	// no leading zeros
+	if (*cursor == '0' && cursor + 1 < end && cursor[1] >= '0' && cursor[1] <= '9')
+		return 0;
 
-						cursor++;
-					}
+	while (cursor < end && *cursor >= '0' && *cursor <= '9')
+	{
+		value = value * 10 + (*cursor - '0');
+		digits++;
+		cursor++;
+	}
 
-					len = cursor - start;
+	if (cursor < end && *cursor == '.')
+	{
+		isDouble = true;
+		cursor++;
 
-					std::string Value = "";
-					Value.assign( start, len );
+		if (cursor == end || *cursor < '0' || *cursor > '9')
+			return 0;
 
-					//cursor++;
+		while (cursor < end && *cursor >= '0' && *cursor <= '9')
+			cursor++;
+	}
 
-					N->set( Name, Value );					
-				}
-				else
-				if (*cursor == '-' || (*cursor >= '0' && *cursor <= '9')) // number or neg number
-				{
+	if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+	{
+		isDouble = true;
+		cursor++;
 
-					bool isDouble = false;
-					std::string Value = ParseNumeric( cursor, isDouble );
+		if (cursor < end && (*cursor == '+' || *cursor == '-'))
+			cursor++;
 
-					if (isDouble)
-					{
-						char* endp;
-						double D = strtod( Value.c_str(), &endp ); 
-						N->set( Name, D );					
-					}
-					else
-					{
-						char* endp;
-						int64_t LL = strtoll( Value.c_str(), &endp, 10 ); 
-						N->set( Name, LL );					
-					}
+		if (cursor == end || *cursor < '0' || *cursor > '9')
+			return 0;
 
-					continue;
-				}
-				else
-				if (*cursor == 'N' || *cursor == 'n') // skip null
-				{
-					N->set(Name);
-					cursor += 4;
-					continue;
-				}
-				else
-				if (*cursor == 'u' || *cursor == 'U') // skip undefined
-				{
-					cursor += 8;
-				}
-				else
-				if (*cursor == 't' || *cursor == 'f')
-				{
+		while (cursor < end && *cursor >= '0' && *cursor <= '9')
+			cursor++;
+	}
+
+	if (cursor != end)
+		return 0;
 
-					bool TF = false;
+	if (!Convert)
+		return (isDouble) ? 2 : 1;
 
-					if (*cursor == 't')
-					{
-						TF = true;
-						cursor += 3;
-					}
-					else
-						cursor += 4;
+	// 19 digits may overflow, value is exact as long as it fits
+	if (!isDouble && (digits < 19 || 
+		(digits == 19 && value <= (uint64_t)INT64_MAX + (negative ? 1 : 0))))
+	{
+		Int = (negative) ? (int64_t)(0 - value) : (int64_t)value;
+		return 1;
+	}
 
-					N->set( Name, TF );					
-				}
-				
-				cursor++;
+	// strtod needs a terminated copy, numbers are short so
+	// this is usually on the stack
+	char buffer[64];
+	size_t length = end - start;
+	std::string longNumber;
+	const char* text = buffer;
 
-			}
+	if (length < sizeof(buffer))
+	{
+		memcpy(buffer, start, length);
+		buffer[length] = 0;
+	}
+	else
+	{
+		longNumber.assign(start, length);
+		text = longNumber.c_str();
+	}
 
+	Dbl = strtod(text, NULL);
+	return 2;
+}
 
-		}
-		else
-		cursor++;
+/*
+  Instrumentation - see CJSON_INSTRUMENT
+*/
 
+static cjson::InstrumentHook instrumentHook = NULL;
+static void* instrumentContext = NULL;
 
-	};
+cjson::Counters& cjson::ThreadCounters()
+{
+	static thread_local Counters counters;
+	return counters;
+}
 
-	return N;
-	
+void cjson::SetInstrumentHook(InstrumentHook Hook, void* Context)
+{
+	instrumentHook = Hook;
+	instrumentContext = Context;
 }
 
+#ifdef CJSON_INSTRUMENT
+// times a Parse or Stringify call, adding it to Time, and passes what 
+// the call counted to the hook
+struct instrumentPhase
+{
+	const char* phase;
+	uint64_t cjson::Counters::* time;
+	cjson::Counters before;
+	std::chrono::steady_clock::time_point start;
+
+	instrumentPhase(const char* Phase, uint64_t cjson::Counters::* Time) :
+		phase(Phase),
+		time(Time),
+		before(cjson::ThreadCounters()),
+		start(std::chrono::steady_clock::now())
+	{}
+
+	~instrumentPhase()
+	{
+		cjson::Counters& counters = cjson::ThreadCounters();
+		counters.*time += std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count();
+
+		if (!instrumentHook)
+			return;
+
+		// Counters is all uint64_t
+		cjson::Counters call;
+		uint64_t* delta = (uint64_t*)&call;
+		const uint64_t* from = (const uint64_t*)&before;
+		const uint64_t* to = (const uint64_t*)&counters;
+
+		for (size_t i = 0; i < sizeof(cjson::Counters) / sizeof(uint64_t); i++)
+			delta[i] = to[i] - from[i];
+
+		instrumentHook(instrumentContext, phase, call);
+	}
+};
+
+#define CJSON_PHASE(Phase, Time) instrumentPhase phaseCounter(Phase, &cjson::Counters::Time)
+#else
+#define CJSON_PHASE(Phase, Time) ((void)0)
+#endif
 
 /*
   Member functions for cjson
@@ -334,7 +607,10 @@ cjson::cjson(HeapStack* MemObj, cjson* RootObj) :
 	siblingNext(NULL),
 	membersHead(NULL),
 	membersTail(NULL),
-	memberCount(0)
+	memberCount(0),
+	nodeFlags(0),
+	nodeHash(0),
+	nodeCache(NULL)
 {
 };
 
@@ -353,6 +629,13 @@ cjsonType cjson::type()
 
 void cjson::setName(const char* newName)
 {
+	if (readOnly())
+		return;
+
+	// names are part of the parents hash
+	if (parentNode)
+		parentNode->changed();
+
 	if (newName)
 	{
 		size_t len = strlen(newName) + 1;
@@ -368,19 +651,41 @@ void cjson::setName(std::string newName)
 
 void cjson::setType(cjsonType Type)
 {
+	if (readOnly())
+		return;
+
+	changed();
 	nodeType = Type;
 }
 
 
 cjson* cjson::createNode()
 {
+	if (readOnly())
+		return NULL;
+
 	char* nodePtr = mem->newPtr(sizeof(cjson));
-	return new (nodePtr) cjson(mem, rootNode );
+	return new (nodePtr) cjson(mem, root());
+};
+
+cjson* cjson::createValueNode(cjsonType Type, size_t DataSize)
+{
+	if (readOnly())
+		return NULL;
+
+	char* nodePtr = mem->newPtr(sizeof(cjson) + DataSize);
+	cjson* newNode = new (nodePtr) cjson(mem, root());
+	newNode->nodeType = Type;
+	newNode->nodeData = (dataUnion*)(nodePtr + sizeof(cjson));
+	return newNode;
 };
 
 cjson* cjson::createNode(cjsonType Type, const char* Name)
 {
 	cjson* newNode = createNode();
+	if (!newNode)
+		return NULL;
+
 	newNode->setName(Name);
 	newNode->nodeType = Type;
 	return newNode;
@@ -389,6 +694,9 @@ cjson* cjson::createNode(cjsonType Type, const char* Name)
 cjson* cjson::createNode(cjsonType Type, std::string Name)
 {
 	cjson* newNode = createNode();
+	if (!newNode)
+		return NULL;
+
 	newNode->setName(Name.c_str());
 	newNode->nodeType = Type;
 	return newNode;
@@ -396,6 +704,12 @@ cjson* cjson::createNode(cjsonType Type, std::string Name)
 
 void cjson::removeNode()
 {
+	if (readOnly())
+		return;
+
+	changed();
+	Unlink();
+
 	nodeType = cjsonType::VOIDED;
 	nodeName = NULL;
 	nodeData = NULL;
@@ -452,6 +766,21 @@ std::vector< std::string> cjson::getKeys()
 	return names;
 }
 
+// the members of a frozen ARRAY or OBJECT (nodeCache points at it), 
+// count member pointers follow it and then, for objects, capacity 
+// slots holding member index + 1 (0 is empty) placed by key hash
+struct cjson::FrozenIndex
+{
+	int count;
+	int capacity; // power of 2, 0 for arrays
+
+	cjson** members() { return (cjson**)(this + 1); }
+	uint32_t* slots() { return (uint32_t*)(members() + count); }
+
+	cjson* find(const char* Name);
+	void add(uint32_t Member);
+};
+
 std::vector< cjson* > cjson::getNodes()
 {
 
@@ -464,6 +793,12 @@ std::vector< cjson* > cjson::getNodes()
 		nodeType != cjsonType::OBJECT)
 		return array; // return an empty array
 
+	if (FrozenIndex* index = frozenIndex())
+	{
+		array.assign(index->members(), index->members() + index->count);
+		return array;
+	}
+
 	cjson* n = membersHead;
 
 	while (n)
@@ -486,6 +821,11 @@ cjson* cjson::at(int index)
 	// array type functions would proably be best
 	//
 	// i.e. GetNodes();
+	//
+	// (frozen documents keep an array of members)
+
+	if (FrozenIndex* frozen = frozenIndex())
+		return (index >= 0 && index < frozen->count) ? frozen->members()[index] : NULL;
 
 	int iter = 0;
 	cjson* n = membersHead;
@@ -506,12 +846,15 @@ cjson* cjson::at(int index)
 cjson* cjson::find(const char* Name)
 {
 
-	int Count = this->size();
+	if (FrozenIndex* index = frozenIndex())
+		return index->find(Name);
 
 	cjson* n = membersHead;
 
 	while (n)
 	{
+		CJSON_COUNT(findCompares, 1);
+
 		if (n->nodeName && strcmp(n->nodeName, Name) == 0)
 			return n;
 
@@ -526,7 +869,8 @@ int cjson::getIndex()
 
 	cjson* n = this->siblingPrev;
 
-	if (!n)
+	// a removed node keeps it's old links
+	if (!n || !parentNode)
 		return 0;
 
 	while (1) // rewind
@@ -559,6 +903,9 @@ cjson* cjson::find(std::string Name)
 // helper, append a value to an array
 cjson* cjson::push(int64_t Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* newNode = createNode();
 	// initialize the node
 	newNode->replace(Value);
@@ -569,6 +916,9 @@ cjson* cjson::push(int64_t Value)
 // helper, append a value to an array
 cjson* cjson::push(double Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* newNode = createNode();
 	// initialize the node
 	newNode->replace(Value);
@@ -579,6 +929,9 @@ cjson* cjson::push(double Value)
 // helper, append a value to an array
 cjson* cjson::push(const char* Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* newNode = createNode();
 	// initialize the node
 	newNode->replace(Value);
@@ -589,6 +942,9 @@ cjson* cjson::push(const char* Value)
 // helper, append a value to an array
 cjson* cjson::push(std::string Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* newNode = createNode();
 	// initialize the node
 	newNode->replace(Value);
@@ -599,6 +955,9 @@ cjson* cjson::push(std::string Value)
 // helper, append a value to an array
 cjson* cjson::push(bool Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* newNode = createNode();
 	// initialize the node
 	newNode->replace(Value);
@@ -609,6 +968,25 @@ cjson* cjson::push(bool Value)
 // helper, append a value to an array
 cjson* cjson::push(cjson* Node)
 {
+	if (readOnly())
+		return NULL;
+
+	if (Node->mem != mem)
+	{
+		// from another document (or a snapshot), push a copy
+		Node = Clone(Node, this);
+	}
+	else
+	{
+		// from this document, move it (a node can't be moved 
+		// into itself)
+		for (cjson* n = this; n; n = n->parentNode)
+			if (n == Node)
+				return NULL;
+
+		Node->Unlink();
+	}
+
 	Link(Node);
 	return Node;
 };
@@ -617,6 +995,9 @@ cjson* cjson::push(cjson* Node)
 // append a nested array onto the array
 cjson* cjson::pushArray()
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* newNode = createNode();
 	// initialize the node
 	newNode->nodeType = cjsonType::ARRAY;
@@ -628,6 +1009,9 @@ cjson* cjson::pushArray()
 // append a nested document onto the array
 cjson* cjson::pushObject()
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* newNode = createNode();
 
 	// initialize the node
@@ -641,6 +1025,9 @@ cjson* cjson::pushObject()
 // adds or updates an existing key value pair in a doc type node
 cjson* cjson::set(const char* Key, int64_t Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* Node = find(Key);
 
 	if (!Node)
@@ -665,6 +1052,9 @@ cjson* cjson::set(std::string Key, int64_t Value)
 // adds or updates an existing key value pair in a doc type node
 cjson* cjson::set(const char* Key, double Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* Node = find(Key);
 
 	if (!Node)
@@ -690,6 +1080,9 @@ cjson* cjson::set(std::string Key, double Value)
 // adds or updates an existing key value pair in a doc type node
 cjson* cjson::set(const char* Key, const char* Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* Node = find(Key);
 
 	if (!Node)
@@ -714,6 +1107,9 @@ cjson* cjson::set(std::string Key, std::string Value)
 
 cjson* cjson::set(const char* Key, bool Value)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* Node = find(Key);
 
 	if (!Node)
@@ -739,6 +1135,9 @@ cjson* cjson::set(std::string Key, bool Value)
 // adds null
 cjson* cjson::set(const char* Key)
 {
+	if (readOnly())
+		return NULL;
+
 	cjson* Node = find(Key);
 
 	if (!Node)
@@ -750,7 +1149,7 @@ cjson* cjson::set(const char* Key)
 		Node = newNode;
 	}
 
-	Node->nodeType = cjsonType::NUL;
+	Node->replace();
 	return Node;
 }
 
@@ -769,6 +1168,9 @@ cjson* cjson::setArray(const char* Key)
 
 	if (!Node)
 	{
+		if (readOnly())
+			return NULL;
+
 		cjson* newNode = createNode();
 
 		newNode->setName(Key);
@@ -793,6 +1195,9 @@ cjson* cjson::setObject(const char* Key)
 
 	if (!Node)
 	{
+		if (readOnly())
+			return NULL;
+
 		cjson* newNode = createNode();
 
 		newNode->setName(Key);
@@ -818,6 +1223,11 @@ int cjson::size()
 
 void cjson::replace(int64_t Val)
 {
+	if (readOnly())
+		return;
+
+	changed();
+
 	nodeType = cjsonType::INT;
 	nodeData = (dataUnion*)mem->newPtr(sizeof(Val));
 	nodeData->asInt = Val;
@@ -825,6 +1235,11 @@ void cjson::replace(int64_t Val)
 
 void cjson::replace(double Val)
 {
+	if (readOnly())
+		return;
+
+	changed();
+
 	nodeType = cjsonType::DBL;
 	nodeData = (dataUnion*)mem->newPtr(sizeof(Val));
 	nodeData->asDouble = Val;
@@ -832,6 +1247,11 @@ void cjson::replace(double Val)
 
 void cjson::replace(const char* Val)
 {
+	if (readOnly())
+		return;
+
+	changed();
+
 	nodeType = cjsonType::STR;
 
 	size_t len = strlen(Val) + 1;
@@ -850,13 +1270,23 @@ void cjson::replace(std::string Val)
 
 void cjson::replace()
 {
-	nodeType = cjsonType::NUL;
-	nodeData = NULL;	
+	if (readOnly())
+		return;
+
+	changed();
+
+	nodeType = cjsonType::NUL;
+	nodeData = NULL;	
 }
 
 
 void cjson::replace(bool Val)
 {
+	if (readOnly())
+		return;
+
+	changed();
+
 	nodeType = cjsonType::BOOL;
 	nodeData = (dataUnion*)mem->newPtr(sizeof(Val));
 	nodeData->asBool = Val;
@@ -967,7 +1397,7 @@ bool cjson::isStringCstr( char* &Value )
 {
 	if (nodeType == cjsonType::STR)
 	{
-		Value = (char*)nodeData;
+		Value = &nodeData->asStr;
 		return true;
 	}
 	return false;
@@ -977,7 +1407,7 @@ bool cjson::isString( std::string &Value )
 {
 	if (nodeType == cjsonType::STR)
 	{
-		Value = (char*)nodeData;
+		Value = &nodeData->asStr;
 		return true;
 	}
 	return false;
@@ -1020,287 +1450,5925 @@ bool cjson::isNull()
 	return false;
 };
 
-cjson* cjson::Parse( const char* JSON )
+/*
+  Hashing
+*/
+
+// splitmix64 finalizer
+__forceinline uint64_t hashMix(uint64_t h)
 {
-	char* cursor = (char*)JSON;
-	return cjson::ParseBranch( NULL, cursor );
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
 }
 
-cjson* cjson::Parse(std::string JSON)
+// hash Length bytes of Text 8 bytes at a time
+uint64_t hashText(uint64_t h, const char* Text, size_t length)
 {
-	return cjson::Parse(JSON.c_str());
-};
+	uint64_t chunk;
 
-char* cjson::StringifyCstr(cjson* N)
-{
-	char* buffer = new char[N->mem->getBytes()];
-	char* writer = buffer;
+	h ^= length;
+
+	while (length >= 8)
+	{
+		memcpy(&chunk, Text, 8);
+		h = (h ^ chunk) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+		Text += 8;
+		length -= 8;
+	}
 
-	N->Stringify_worker(N, writer);
+	chunk = 0;
+	memcpy(&chunk, Text, length);
 
-	*writer = 0;
-	return buffer;
+	return hashMix(h ^ chunk);
 }
 
-std::string cjson::Stringify(cjson* N)
+uint64_t hashText(uint64_t h, const char* Text)
 {
-	return std::string(StringifyCstr(N));
+	return hashText(h, Text, strlen(Text));
 }
 
-
-void cjson::DisposeDocument( cjson* Document )
+// node name or "" for nodes without one
+__forceinline const char* memberName(cjson* N)
 {
-	delete Document->mem;
-};
+	const char* name = N->nameCstr();
+	return (name) ? name : "";
+}
 
-cjson* cjson::MakeDocument()
+void cjson::changed()
 {
-	HeapStack* mem = new HeapStack( 2048 );
-	void* Data = mem->newPtr(sizeof(cjson));
-
-	// we are going to allocate this node using "palcement new"
-	// in the HeapStack
-	cjson* newNode = new (Data) cjson(mem, NULL);
+	nodeFlags &= ~MEMOIZED;
+
+	// arrays and objects under a node with memoized values are always 
+	// marked as well (hashing or caching a node visits them), so the 
+	// first unmarked parent means everything above it is unmarked.
+	// Values aren't marked by caching, so this node doesn't count.
+	for (cjson* n = parentNode; n && (n->nodeFlags & MEMOIZED); n = n->parentNode)
+		n->nodeFlags &= ~MEMOIZED;
+}
 
-	newNode->setName("__root__");
-	newNode->setType(cjsonType::OBJECT);
+// hashes of read only arrays and objects (which can't memoize their 
+// own) for the length of one call, keyed by node
+typedef std::unordered_map< cjson*, uint64_t > hashMemo;
 
-	return newNode;
-};
+uint64_t cjson::hash(bool Unordered)
+{
+	return hash_worker(Unordered, NULL);
+}
 
-cjson* cjson::GetNodeByPath(std::string Path)
+uint64_t cjson::hash_worker(bool Unordered, void* Hashes)
 {
+	int mode = (Unordered) ? (HASH_VALID | HASH_UNORDERED) : HASH_VALID;
 
-	cjson* N = this;
+	if ((nodeFlags & (HASH_VALID | HASH_UNORDERED)) == mode)
+		return nodeHash;
 
-	std::vector<std::string> parts;
-	Split(Path, '/', parts);
+	hashMemo* memo = (Hashes && readOnly() && 
+		(nodeType == cjsonType::ARRAY || nodeType == cjsonType::OBJECT)) ? (hashMemo*)Hashes : NULL;
 
-	for (int i = 0; i < parts.size(); i++)
+	if (memo)
 	{
+		hashMemo::iterator found = memo->find(this);
 
-		switch (N->nodeType)
-		{
-		case cjsonType::OBJECT:
-		{
-			cjson* Next = N->find(parts[i]);
-
-			if (!Next)
-				return NULL;
+		if (found != memo->end())
+			return found->second;
+	}
 
-			N = Next;
+	uint64_t h = hashMix((uint64_t)nodeType);
 
-		}
+	switch (nodeType)
+	{
+	case cjsonType::INT:
+		if (nodeData)
+			h = hashMix(h ^ nodeData->asInt);
 		break;
-		case cjsonType::ARRAY:
+	case cjsonType::DBL:
+		if (nodeData)
 		{
-			int Index = atoi(parts[i].c_str());
-
-			if (Index < 0 || Index >= N->size())
-				return NULL;
+			// -0.0 == 0.0 so they have to hash the same
+			double value = (nodeData->asDouble == 0) ? 0 : nodeData->asDouble;
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			h = hashMix(h ^ bits);
+		}
+		break;
+	case cjsonType::BOOL:
+		if (nodeData)
+			h = hashMix(h ^ (nodeData->asBool ? 1 : 2));
+		break;
+	case cjsonType::STR:
+		if (nodeData)
+			h = hashText(h, &nodeData->asStr);
+		break;
+	case cjsonType::ARRAY:
+		for (cjson* n = membersHead; n; n = n->siblingNext)
+			if (n->nodeType != cjsonType::VOIDED)
+				h = hashMix(h ^ n->hash_worker(Unordered, Hashes));
+		break;
+	case cjsonType::OBJECT:
+	{
+		// members are summed when Unordered so order doesn't matter
+		uint64_t sum = 0;
 
-			N = N->at(Index);
+		for (cjson* n = membersHead; n; n = n->siblingNext)
+		{
+			if (n->nodeType == cjsonType::VOIDED)
+				continue;
 
-			if (!N)
-				return NULL;
+			uint64_t member = hashText(0, memberName(n)) ^ n->hash_worker(Unordered, Hashes);
 
-		}
-		break;
+			if (Unordered)
+				sum += hashMix(member);
+			else
+				h = hashMix(h ^ member);
 		}
 
+		h = hashMix(h ^ sum);
+	}
+	break;
+	default:
+		break;
 	}
 
-	return N;
+	// snapshots can't be written to, so they are hashed every time
+	// (or once per call when given Hashes)
+	if (!readOnly())
+	{
+		nodeHash = h;
+		nodeFlags = (nodeFlags & ~(HASH_VALID | HASH_UNORDERED)) | mode;
+	}
+	else if (memo)
+		(*memo)[this] = h;
 
+	return h;
 }
 
-// internal add member
-void cjson::Link(cjson* newNode)
+bool cjson::equals(cjson* A, cjson* B, bool Unordered)
 {
+	return equals_worker(A, B, Unordered, NULL);
+}
 
-	newNode->parentNode = this;
+bool cjson::equals_worker(cjson* A, cjson* B, bool Unordered, void* Hashes)
+{
+	if (A == B)
+		return true;
 
-	// members are basically children directly owned
-	// by the current node. They are stored as a linked
-	// list maintained by the parent node.
-	// nodes can also see their siblings via siblingPrev and
-	// siblingNext
+	if (!A || !B || A->nodeType != B->nodeType || 
+		A->hash_worker(Unordered, Hashes) != B->hash_worker(Unordered, Hashes))
+		return false;
 
-	if (!membersHead)
+	// hashes match, so this is very likely equal, confirm it
+	switch (A->nodeType)
 	{
-		membersHead = newNode;
-		membersTail = newNode;
-		newNode->siblingNext = NULL;
-		newNode->siblingPrev = NULL;
-	}
-	else
+	case cjsonType::INT:
+	case cjsonType::DBL:
+	case cjsonType::BOOL:
+	case cjsonType::STR:
+		if (!A->nodeData || !B->nodeData)
+			return (!A->nodeData && !B->nodeData);
+
+		switch (A->nodeType)
+		{
+		case cjsonType::INT:
+			return (A->nodeData->asInt == B->nodeData->asInt);
+		case cjsonType::DBL:
+			return (A->nodeData->asDouble == B->nodeData->asDouble);
+		case cjsonType::BOOL:
+			return (A->nodeData->asBool == B->nodeData->asBool);
+		default:
+			return (strcmp(&A->nodeData->asStr, &B->nodeData->asStr) == 0);
+		}
+	case cjsonType::ARRAY:
+	case cjsonType::OBJECT:
 	{
-		cjson* lastTail = membersTail;
-		// set the current tails sibling to the node		
-		membersTail->siblingNext = newNode;
-		// new nodes previous is the last tail
-		newNode->siblingPrev = lastTail;
-		// set the current tail to the node;
-		membersTail = newNode;
-	}
+		cjson* a = A->membersHead;
+		cjson* b = B->membersHead;
 
-	memberCount++;
+		while (true)
+		{
+			while (a && a->nodeType == cjsonType::VOIDED)
+				a = a->siblingNext;
+			while (b && b->nodeType == cjsonType::VOIDED)
+				b = b->siblingNext;
 
-};
+			if (!a || !b)
+				break;
 
-// helper for Stringify_worder
-__forceinline void emitText(char* &writer, const char* text)
-{
-	while (*text)
-	{
-		*writer = *text;
-		++writer;
-		++text;
-	}
-}
+			if (A->nodeType == cjsonType::OBJECT && Unordered)
+			{
+				if (!equals_worker(a, B->find(memberName(a)), Unordered, Hashes))
+					return false;
+			}
+			else
+			{
+				if (A->nodeType == cjsonType::OBJECT && strcmp(memberName(a), memberName(b)) != 0)
+					return false;
 
-// helper for Stringify_worder
-__forceinline void emitText(char* &writer, const char text)
-{
-	*writer = text;
-	++writer;
+				if (!equals_worker(a, b, Unordered, Hashes))
+					return false;
+			}
+
+			a = a->siblingNext;
+			b = b->siblingNext;
+		}
+
+		return (!a && !b);
+	}
+	default:
+		return true;
+	}
 }
 
+/*
+  Typed binding
+*/
 
-void cjson::Stringify_worker(cjson* N, char* &writer)
+cjson::BindTable::BindTable(const BindField* Fields, size_t Count) :
+	fields(Fields),
+	count(Count)
 {
+	size_t size = 4;
 
-	std::string pad = "";
-	std::string padshort = "";
-
-	bool AppendDoc = false;
+	while (size < Count * 2)
+		size <<= 1;
 
-	switch (N->nodeType)
+	// look for a size where no two keys share a slot so every lookup
+	// is one probe, keys that collide anyway are found by probing
+	for (int attempt = 0; ; attempt++, size <<= 1)
 	{
-	case cjsonType::NUL:
-		if (N->hasName())
-		{
-			emitText(writer, '"');
-			emitText(writer, N->nameCstr());
-			emitText(writer, "\":");
-		}
+		bool perfect = true;
 
-		emitText(writer, "null");
+		slots.assign(size, -1);
+		mask = size - 1;
 
-		break;
-	case cjsonType::INT:
-		if (N->hasName())
+		for (size_t i = 0; i < Count; i++)
 		{
-			emitText(writer, '"');
-			emitText(writer, N->nameCstr());
-			emitText(writer, "\":");
-		}
+			size_t slot = Fields[i].hash & mask;
 
-		writer += sprintf(writer, "%ld", N->nodeData->asInt);
-		//emitText(writer, std::to_string(N->nodeData->asInt).c_str());
+			if (slots[slot] != -1)
+			{
+				perfect = false;
 
-		break;
-	case cjsonType::DBL:
-		if (N->hasName())
-		{
-			emitText(writer, '"');
-			emitText(writer, N->nameCstr());
-			emitText(writer, "\":");
-		}
+				while (slots[slot] != -1)
+					slot = (slot + 1) & mask;
+			}
 
-		if (N->nodeData->asDouble == 0)
-		{
-			emitText(writer, "0.0");
-		}
-		else
-		{
-			//doc.setf(std::ios_base::fixed, std::ios::floatfield);
-			//doc << std::setprecision(9) << N->nodeData->asDouble;
-			//emitText(writer, std::to_string(N->nodeData->asDouble).c_str());
-			writer += sprintf(writer, "%0.7f", N->nodeData->asDouble);
+			slots[slot] = (int)i;
 		}
 
-		break;
-	case cjsonType::STR:
-		if (N->hasName())
-		{
-			emitText(writer, '"');
-			emitText(writer, N->nameCstr());
-			emitText(writer, "\":");
-		}
+		if (perfect || attempt == 4)
+			break;
+	}
+}
 
-		emitText(writer, '"');
-		emitText(writer, (char*)N->nodeData);
-		emitText(writer, '"');
+const cjson::BindField* cjson::BindTable::find(const char* Key, size_t Length) const
+{
+	// same as BindField::keyHash
+	uint64_t hash = 0xcbf29ce484222325ULL;
 
-		break;
-	case cjsonType::BOOL:
-		if (N->hasName())
-		{
-			emitText(writer, '"');
-			emitText(writer, N->nameCstr());
-			emitText(writer, "\":");
-		}
+	for (size_t i = 0; i < Length; i++)
+		hash = (hash ^ (unsigned char)Key[i]) * 0x100000001b3ULL;
 
-		emitText(writer, (N->nodeData->asBool) ? "true" : "false");
+	for (size_t slot = hash & mask; slots[slot] != -1; slot = (slot + 1) & mask)
+	{
+		const BindField& field = fields[slots[slot]];
 
-		break;
-	case cjsonType::ARRAY:
+		if (field.hash == hash && field.length == Length && memcmp(field.key, Key, Length) == 0)
+			return &field;
+	}
+
+	return NULL;
+}
+
+void cjson::BindWriteObject(Writer& writer, const BindTable& Table, const void* Object)
+{
+	writer.beginObject();
+
+	for (size_t i = 0; i < Table.count; i++)
 	{
-		int Count = N->size();
+		writer.key(Table.fields[i].key, Table.fields[i].length);
+		Table.fields[i].write(writer, Object);
+	}
 
-		if (!N->hasName() || strcmp( N->nameCstr() , "__root__" ) == 0)
-			emitText(writer, '[');
-		else
-		{
-			emitText(writer, '"');
-			emitText(writer, N->nameCstr());
-			emitText(writer, "\":[");
-		}
+	writer.endObject();
+}
 
-		auto members = N->getNodes();
-		for (int i = 0; i < Count; i++)
-		{
-			if (i) emitText(writer, ',');
+// values nested deeper than this fail rather than recurse, bound 
+// structs can contain themselves (through a vector) so this also 
+// applies to them
+static const int maxBindDepth = 1024;
 
-			cjson::Stringify_worker(members[i], writer);
-		}
+cjson::BindReader::BindReader(const char* JSON, size_t Length) :
+	start(JSON),
+	cursor(JSON),
+	end(JSON + Length),
+	depth(0)
+{
+}
+
+__forceinline void cjson::BindReader::space()
+{
+	while (cursor < end && 
+		(*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n'))
+		++cursor;
+}
 
-		emitText(writer, ']');
+__forceinline bool cjson::BindReader::expect(char C)
+{
+	space();
 
+	if (cursor < end && *cursor == C)
+	{
+		++cursor;
+		return true;
 	}
-	break;
 
-	case cjsonType::OBJECT:
+	return false;
+}
+
+// read a string, Text points into the JSON or into scratch if the 
+// string had escapes
+bool cjson::BindReader::text(const char*& Text, size_t& Length)
+{
+	if (!expect('"'))
+		return false;
+
+	bool escaped;
+	const char* close = ScanQuote(cursor, end, escaped);
+
+	// control characters must be escaped
+	if (close == end || *close != '"')
+		return false;
+
+	Text = cursor;
+	Length = close - cursor;
+
+	if (escaped)
 	{
-		int Count = N->size();
+		scratch.resize(Length);
 
-		if (!N->hasName() || strcmp(N->nameCstr(), "__root__") == 0)
-			emitText(writer, '{');
-		else
-		{
-			emitText(writer, '"');
-			emitText(writer, N->nameCstr());
-			emitText(writer, "\":{");
-		}
+		if (!Unescape(cursor, close - cursor, &scratch[0], Length))
+			return false;
 
+		Text = scratch.data();
+	}
 
-		auto members = N->getNodes();
+	cursor = close + 1;
+	return true;
+}
 
-		for (int i = 0; i < Count; i++)
-		{
-			if (i) emitText(writer, ',');;
+// returns 1 for an integer, 2 for a double and 0 if there isn't a number
+int cjson::BindReader::number(int64_t& Int, double& Dbl)
+{
+	space();
 
-			cjson::Stringify_worker(members[i], writer);
-		}
+	const char* first = cursor;
+
+	while (cursor < end &&
+		((*cursor >= '0' && *cursor <= '9') ||
+		*cursor == '-' || *cursor == '+' || *cursor == '.' ||
+		*cursor == 'e' || *cursor == 'E'))
+		++cursor;
+
+	int type = (cursor > first) ? ParseNumber(first, cursor, Int, Dbl) : 0;
+
+	if (!type)
+		cursor = first;
+
+	return type;
+}
+
+bool cjson::BindReader::integer(int64_t& Value)
+{
+	double unused;
+	return number(Value, unused) == 1;
+}
 
-		emitText(writer, '}');
+bool cjson::BindReader::real(double& Value)
+{
+	int64_t Int;
 
+	switch (number(Int, Value))
+	{
+	case 1:
+		Value = (double)Int;
+		return true;
+	case 2:
+		return true;
+	default:
+		return false;
 	}
+}
 
-	break;
+bool cjson::BindReader::boolean(bool& Value)
+{
+	space();
+
+	if (end - cursor >= 4 && memcmp(cursor, "true", 4) == 0)
+	{
+		cursor += 4;
+		Value = true;
+		return true;
+	}
 
+	if (end - cursor >= 5 && memcmp(cursor, "false", 5) == 0)
+	{
+		cursor += 5;
+		Value = false;
+		return true;
 	}
 
+	return false;
 }
 
+bool cjson::BindReader::string(std::string& Value)
+{
+	const char* Text;
+	size_t Length;
+
+	if (!text(Text, Length))
+		return false;
+
+	Value.assign(Text, Length);
+	return true;
+}
+
+bool cjson::BindReader::null()
+{
+	space();
+
+	if (end - cursor >= 4 && memcmp(cursor, "null", 4) == 0)
+	{
+		cursor += 4;
+		return true;
+	}
+
+	return false;
+}
+
+bool cjson::BindReader::beginArray(bool& Empty)
+{
+	if (depth >= maxBindDepth || !expect('['))
+		return false;
+
+	space();
+	Empty = (cursor < end && *cursor == ']');
+
+	if (Empty)
+		++cursor;
+	else
+		++depth;
+
+	return true;
+}
+
+bool cjson::BindReader::arrayNext(bool& More)
+{
+	space();
+
+	if (cursor < end && (*cursor == ',' || *cursor == ']'))
+	{
+		More = (*cursor++ == ',');
+
+		if (!More)
+			--depth;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool cjson::BindReader::object(const BindTable& Table, void* Object)
+{
+	if (depth >= maxBindDepth || !expect('{'))
+		return false;
+
+	space();
+
+	if (cursor < end && *cursor == '}')
+	{
+		++cursor;
+		return true;
+	}
+
+	++depth;
+
+	while (true)
+	{
+		const char* key;
+		size_t keyLength;
+
+		if (!text(key, keyLength))
+			return false;
+
+		// key may be in scratch, so find the field before the value
+		// is read
+		const BindField* field = Table.find(key, keyLength);
+
+		if (!expect(':'))
+			return false;
+
+		if (field)
+		{
+			if (!field->read(*this, Object))
+				return false;
+		}
+		else if (!skip())
+		{
+			return false;
+		}
+
+		space();
+
+		if (cursor < end && *cursor == ',')
+		{
+			++cursor;
+			continue;
+		}
+
+		if (cursor < end && *cursor == '}')
+		{
+			++cursor;
+			--depth;
+			return true;
+		}
+
+		return false;
+	}
+}
+
+// skip (but check) a value that has no member to go in
+bool cjson::BindReader::skip()
+{
+	const char* Text;
+	size_t Length;
+	int64_t Int;
+	double Dbl;
+	bool Bool;
+
+	space();
+
+	if (cursor >= end)
+		return false;
+
+	switch (*cursor)
+	{
+	case '{':
+		if (depth >= maxBindDepth)
+			return false;
+
+		++cursor;
+		space();
+
+		if (cursor < end && *cursor == '}')
+		{
+			++cursor;
+			return true;
+		}
+
+		++depth;
+
+		while (true)
+		{
+			if (!text(Text, Length) || !expect(':') || !skip())
+				return false;
+
+			if (expect(','))
+				continue;
+
+			--depth;
+			return expect('}');
+		}
+	case '[':
+	{
+		bool more;
+
+		if (!beginArray(more))
+			return false;
+
+		more = !more;
+
+		while (more)
+		{
+			if (!skip() || !arrayNext(more))
+				return false;
+		}
+
+		return true;
+	}
+	case '"':
+		return text(Text, Length);
+	case 't':
+	case 'f':
+		return boolean(Bool);
+	case 'n':
+		return null();
+	default:
+		return number(Int, Dbl) != 0;
+	}
+}
+
+bool cjson::BindReader::finish()
+{
+	space();
+	return cursor == end;
+}
+
+size_t cjson::BindReader::offset()
+{
+	return cursor - start;
+}
+
+/*
+  JSON Patch and Merge Patch
+*/
+
+// append Key to a JSON Pointer, escaping ~ and /
+void pointerAppend(std::string& Pointer, const char* Key)
+{
+	Pointer += '/';
+
+	for (; *Key; Key++)
+	{
+		if (*Key == '~')
+			Pointer += "~0";
+		else if (*Key == '/')
+			Pointer += "~1";
+		else
+			Pointer += *Key;
+	}
+}
+
+void pointerAppend(std::string& Pointer, size_t Index)
+{
+	Pointer += '/';
+	Pointer += std::to_string(Index);
+}
+
+// split a JSON Pointer into unescaped tokens, returns false if 
+// the pointer is malformed
+bool pointerSplit(const char* Pointer, std::vector< std::string >& Tokens)
+{
+	if (*Pointer && *Pointer != '/')
+		return false;
+
+	while (*Pointer == '/')
+	{
+		std::string token;
+
+		for (++Pointer; *Pointer && *Pointer != '/'; ++Pointer)
+		{
+			if (*Pointer != '~')
+			{
+				token += *Pointer;
+				continue;
+			}
+
+			++Pointer;
+
+			if (*Pointer == '0')
+				token += '~';
+			else if (*Pointer == '1')
+				token += '/';
+			else
+				return false;
+		}
+
+		Tokens.push_back(token);
+	}
+
+	return true;
+}
+
+// array index in a JSON Pointer token, -1 if it isn't one
+int pointerIndex(const std::string& Token)
+{
+	if (Token.empty() || Token.length() > 9 || (Token[0] == '0' && Token.length() > 1))
+		return -1;
+
+	int index = 0;
+
+	for (size_t i = 0; i < Token.length(); i++)
+	{
+		if (Token[i] < '0' || Token[i] > '9')
+			return -1;
+
+		index = (index * 10) + (Token[i] - '0');
+	}
+
+	return index;
+}
+
+// follow the first Count tokens of a JSON Pointer from N
+cjson* pointerFind(cjson* N, const std::vector< std::string >& Tokens, size_t Count)
+{
+	for (size_t i = 0; N && i < Count; i++)
+	{
+		switch (N->type())
+		{
+		case cjsonType::OBJECT:
+			N = N->find(Tokens[i].c_str());
+			break;
+		case cjsonType::ARRAY:
+		{
+			int index = pointerIndex(Tokens[i]);
+			N = (index < 0) ? NULL : N->at(index);
+		}
+		break;
+		default:
+			return NULL;
+		}
+	}
+
+	return N;
+}
+
+// append an operation to a patch document
+void patchOp(cjson* Patch, const char* Op, const std::string& Path, cjson* Value)
+{
+	cjson* op = Patch->pushObject();
+	op->set("op", Op);
+	op->set("path", Path.c_str());
+
+	if (Value)
+		op->push(Value)->setName("value");
+}
+
+void cjson::Diff_worker(cjson* A, cjson* B, std::string& Path, cjson* Patch, void* Hashes)
+{
+	// member order doesn't matter to JSON Patch
+	if (equals_worker(A, B, true, Hashes))
+		return;
+
+	size_t pathLength = Path.length();
+
+	if (A->nodeType == cjsonType::OBJECT && B->nodeType == cjsonType::OBJECT)
+	{
+		// members are usually in the same order in both, so the 
+		// member after the last match is tried before searching
+		cjson* expected = B->membersHead;
+
+		for (cjson* a = A->membersHead; a; a = a->siblingNext)
+		{
+			if (a->nodeType == cjsonType::VOIDED)
+				continue;
+
+			const char* name = memberName(a);
+			cjson* b = (expected && strcmp(memberName(expected), name) == 0) ? expected : B->find(name);
+
+			pointerAppend(Path, name);
+
+			if (b)
+			{
+				Diff_worker(a, b, Path, Patch, Hashes);
+				expected = b->siblingNext;
+			}
+			else
+			{
+				patchOp(Patch, "remove", Path, NULL);
+			}
+
+			Path.resize(pathLength);
+		}
+
+		expected = A->membersHead;
+
+		for (cjson* b = B->membersHead; b; b = b->siblingNext)
+		{
+			if (b->nodeType == cjsonType::VOIDED)
+				continue;
+
+			const char* name = memberName(b);
+			cjson* a = (expected && strcmp(memberName(expected), name) == 0) ? expected : A->find(name);
+
+			if (a)
+			{
+				expected = a->siblingNext;
+				continue;
+			}
+
+			pointerAppend(Path, name);
+			patchOp(Patch, "add", Path, b);
+			Path.resize(pathLength);
+		}
+
+		return;
+	}
+
+	if (A->nodeType == cjsonType::ARRAY && B->nodeType == cjsonType::ARRAY)
+	{
+		std::vector< cjson* > a = A->getNodes();
+		std::vector< cjson* > b = B->getNodes();
+
+		// skip matching items at the start and end
+		size_t start = 0;
+		size_t endA = a.size();
+		size_t endB = b.size();
+
+		while (start < endA && start < endB && equals_worker(a[start], b[start], true, Hashes))
+			start++;
+
+		while (endA > start && endB > start && equals_worker(a[endA - 1], b[endB - 1], true, Hashes))
+		{
+			endA--;
+			endB--;
+		}
+
+		// diff the items in both, then remove or add the rest
+		size_t both = std::min(endA, endB);
+
+		for (size_t i = start; i < both; i++)
+		{
+			pointerAppend(Path, i);
+			Diff_worker(a[i], b[i], Path, Patch, Hashes);
+			Path.resize(pathLength);
+		}
+
+		for (size_t i = both; i < endA; i++)
+		{
+			pointerAppend(Path, both);
+			patchOp(Patch, "remove", Path, NULL);
+			Path.resize(pathLength);
+		}
+
+		for (size_t i = both; i < endB; i++)
+		{
+			pointerAppend(Path, i);
+			patchOp(Patch, "add", Path, b[i]);
+			Path.resize(pathLength);
+		}
+
+		return;
+	}
+
+	patchOp(Patch, "replace", Path, B);
+}
+
+cjson* cjson::Diff(cjson* A, cjson* B)
+{
+	cjson* patch = MakeDocument();
+	patch->setType(cjsonType::ARRAY);
+
+	// unordered hashes of snapshots and frozen documents are kept 
+	// for the whole diff instead of being worked out at every level
+	hashMemo hashes;
+
+	std::string path;
+	Diff_worker(A, B, path, patch, (A->readOnly() || B->readOnly()) ? &hashes : NULL);
+
+	return patch;
+}
+
+// put Value (a detached node in the same document) in place of Node
+void cjson::patchReplace(cjson* Node, cjson* Value)
+{
+	cjson* parent = Node->parentNode;
+
+	if (parent)
+	{
+		Value->nodeName = Node->nodeName;
+		parent->LinkBefore(Value, Node);
+		Node->removeNode();
+		return;
+	}
+
+	// the root can't be swapped, so Value is moved into it
+	while (Node->membersHead)
+		Node->membersHead->removeNode();
+
+	Node->changed();
+	Node->nodeType = Value->nodeType;
+	Node->nodeData = Value->nodeData;
+
+	while (Value->membersHead)
+	{
+		cjson* member = Value->membersHead;
+		member->Unlink();
+		Node->Link(member);
+	}
+}
+
+// add Value (a detached node in this document) at the pointer Tokens
+bool cjson::patchAdd(const std::vector< std::string >& Tokens, cjson* Value)
+{
+	if (Tokens.empty())
+	{
+		patchReplace(this, Value);
+		return true;
+	}
+
+	cjson* parent = pointerFind(this, Tokens, Tokens.size() - 1);
+
+	if (!parent)
+		return false;
+
+	const std::string& last = Tokens.back();
+
+	if (parent->nodeType == cjsonType::OBJECT)
+	{
+		cjson* existing = parent->find(last.c_str());
+
+		if (existing)
+		{
+			patchReplace(existing, Value);
+		}
+		else
+		{
+			Value->setName(last);
+			parent->Link(Value);
+		}
+
+		return true;
+	}
+
+	if (parent->nodeType == cjsonType::ARRAY)
+	{
+		Value->nodeName = NULL;
+
+		if (last == "-")
+		{
+			parent->Link(Value);
+			return true;
+		}
+
+		int index = pointerIndex(last);
+
+		if (index < 0 || index > parent->size())
+			return false;
+
+		parent->LinkBefore(Value, parent->at(index));
+		return true;
+	}
+
+	return false;
+}
+
+bool cjson::ApplyPatch(cjson* Document, cjson* Patch)
+{
+	if (Document->readOnly() || Patch->nodeType != cjsonType::ARRAY)
+		return false;
+
+	for (cjson* op = Patch->membersHead; op; op = op->siblingNext)
+	{
+		if (op->nodeType == cjsonType::VOIDED)
+			continue;
+
+		std::string name = op->xPath("op", std::string());
+		const char* path = op->xPath("path", (const char*)NULL);
+		const char* from = op->xPath("from", (const char*)NULL);
+		cjson* value = op->find("value");
+
+		std::vector< std::string > tokens;
+		std::vector< std::string > fromTokens;
+
+		if (!path || !pointerSplit(path, tokens))
+			return false;
+
+		if (name == "add")
+		{
+			if (!value || !Document->patchAdd(tokens, Clone(value, Document)))
+				return false;
+		}
+		else if (name == "remove")
+		{
+			cjson* node = pointerFind(Document, tokens, tokens.size());
+
+			if (!node || node == Document)
+				return false;
+
+			node->removeNode();
+		}
+		else if (name == "replace")
+		{
+			cjson* node = pointerFind(Document, tokens, tokens.size());
+
+			if (!node || !value)
+				return false;
+
+			patchReplace(node, Clone(value, Document));
+		}
+		else if (name == "move" || name == "copy")
+		{
+			if (!from || !pointerSplit(from, fromTokens))
+				return false;
+
+			cjson* node = pointerFind(Document, fromTokens, fromTokens.size());
+
+			if (!node)
+				return false;
+
+			if (name == "copy")
+			{
+				if (!Document->patchAdd(tokens, Clone(node, Document)))
+					return false;
+
+				continue;
+			}
+
+			if (tokens == fromTokens)
+				continue;
+
+			// a node can't be moved into itself
+			if (node == Document || 
+				(tokens.size() > fromTokens.size() && std::equal(fromTokens.begin(), fromTokens.end(), tokens.begin())))
+				return false;
+
+			node->Unlink();
+
+			if (!Document->patchAdd(tokens, node))
+				return false;
+		}
+		else if (name == "test")
+		{
+			if (!value || !equals(pointerFind(Document, tokens, tokens.size()), value, true))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// merge the members of Patch (an object) into this object
+void cjson::MergePatch_worker(cjson* Patch)
+{
+	for (cjson* p = Patch->membersHead; p; p = p->siblingNext)
+	{
+		if (p->nodeType == cjsonType::VOIDED)
+			continue;
+
+		const char* name = memberName(p);
+		cjson* target = find(name);
+
+		switch (p->nodeType)
+		{
+		case cjsonType::NUL:
+			if (target)
+				target->removeNode();
+			break;
+		case cjsonType::OBJECT:
+			if (!target)
+			{
+				target = setObject(name);
+			}
+			else if (target->nodeType != cjsonType::OBJECT)
+			{
+				cjson* object = createNode(cjsonType::OBJECT, NULL);
+				patchReplace(target, object);
+				target = object;
+			}
+
+			target->MergePatch_worker(p);
+			break;
+		default:
+			if (target)
+				patchReplace(target, Clone(p, this));
+			else
+				Link(Clone(p, this));
+			break;
+		}
+	}
+}
+
+void cjson::ApplyMergePatch(cjson* Document, cjson* Patch)
+{
+	if (Document->readOnly())
+		return;
+
+	if (Patch->nodeType != cjsonType::OBJECT)
+	{
+		patchReplace(Document, Clone(Patch, Document));
+		return;
+	}
+
+	if (Document->nodeType != cjsonType::OBJECT)
+		patchReplace(Document, Document->createNode(cjsonType::OBJECT, NULL));
+
+	Document->MergePatch_worker(Patch);
+}
+
+/*
+  Schema - compiled JSON Schema validation
+*/
+
+// type bits for Schema rules
+enum schemaType_e
+{
+	SCHEMA_NULL = 1,
+	SCHEMA_BOOLEAN = 2,
+	SCHEMA_OBJECT = 4,
+	SCHEMA_ARRAY = 8,
+	SCHEMA_STRING = 16,
+	SCHEMA_NUMBER = 32,
+	SCHEMA_INTEGER = 64,
+	SCHEMA_ANY = 127
+};
+
+// number limits set in a Schema rule
+enum schemaLimit_e
+{
+	LIMIT_MINIMUM = 1,
+	LIMIT_EXCLUSIVE_MINIMUM = 2,
+	LIMIT_MAXIMUM = 4,
+	LIMIT_EXCLUSIVE_MAXIMUM = 8,
+	LIMIT_MULTIPLE_OF = 16
+};
+
+// applicators (allOf, $ref, ...) are expanded at each value, a $ref 
+// that leads back to itself without reading a value fails at this depth
+static const int schemaMaxExpand = 64;
+
+// std::regex (libstdc++ at least) recurses for each character it 
+// matches, longer strings stop validation rather than risk the stack
+static const size_t schemaMaxPatternLength = 1024;
+
+struct cjson::Schema::Program
+{
+	// one rule per (sub) schema. Lists (allOf, anyOf, oneOf, item 
+	// tuples) are ranges of lists, properties are ranges of properties
+	// with a slot table per rule. -1 means not set.
+	struct Rule
+	{
+		unsigned types;
+		unsigned limits; // schemaLimit_e
+		double minimum;
+		double exclusiveMinimum;
+		double maximum;
+		double exclusiveMaximum;
+		double multipleOf;
+		int64_t minLength;
+		int64_t maxLength;
+		int64_t minItems;
+		int64_t maxItems;
+		int64_t minProperties;
+		int64_t maxProperties;
+		int pattern;
+		bool unique;
+		bool isConst;
+		int items;
+		int tupleFirst;
+		int tupleCount;
+		int additionalItems;
+		int propertyFirst;
+		int propertyCount;
+		int slotFirst;
+		int slotMask;
+		int required; // number of required properties
+		int additional;
+		int allFirst;
+		int allCount;
+		int anyFirst;
+		int anyCount;
+		int oneFirst;
+		int oneCount;
+		int notRule;
+		int enumFirst;
+		int enumCount;
+
+		Rule() :
+			types(SCHEMA_ANY),
+			limits(0),
+			minimum(0),
+			exclusiveMinimum(0),
+			maximum(0),
+			exclusiveMaximum(0),
+			multipleOf(0),
+			minLength(0),
+			maxLength(-1),
+			minItems(0),
+			maxItems(-1),
+			minProperties(0),
+			maxProperties(-1),
+			pattern(-1),
+			unique(false),
+			isConst(false),
+			items(-1),
+			tupleFirst(0),
+			tupleCount(0),
+			additionalItems(-1),
+			propertyFirst(0),
+			propertyCount(0),
+			slotFirst(0),
+			slotMask(0),
+			required(0),
+			additional(-1),
+			allFirst(0),
+			allCount(0),
+			anyFirst(0),
+			anyCount(0),
+			oneFirst(0),
+			oneCount(0),
+			notRule(-1),
+			enumFirst(0),
+			enumCount(0)
+		{}
+	};
+
+	struct Property
+	{
+		uint64_t hash;
+		size_t name; // offset in names
+		size_t length;
+		int rule;     // -1 if only listed in required
+		int required; // bit in Check's seen bits, or -1
+	};
+
+	std::vector< Rule > rules;
+	std::vector< Property > properties;
+	std::vector< int > slots;
+	std::vector< int > lists;
+	std::vector< uint64_t > enums; // value hashes
+	std::vector< cjson* > literals; // the values, a hash match is confirmed against them
+	cjson* literalDocument;
+	std::vector< std::regex > patterns;
+	std::string names;
+	int root;
+	bool hashing; // hash every value, not just where enum, const or uniqueItems need it
+
+	Program() :
+		literalDocument(NULL),
+		root(0),
+		hashing(false)
+	{}
+
+	~Program()
+	{
+		if (literalDocument)
+			cjson::DisposeDocument(literalDocument);
+	}
+
+	const Property* find(const Rule& R, const char* Key, size_t Length, uint64_t Hash) const
+	{
+		if (!R.propertyCount)
+			return NULL;
+
+		for (int slot = Hash & R.slotMask; slots[R.slotFirst + slot] != -1; slot = (slot + 1) & R.slotMask)
+		{
+			const Property& property = properties[slots[R.slotFirst + slot]];
+
+			if (property.hash == Hash && property.length == Length && 
+				memcmp(names.data() + property.name, Key, Length) == 0)
+				return &property;
+		}
+
+		return NULL;
+	}
+};
+
+/*
+  Check - runs a Program over Reader events (or a node, see node). 
+
+  Each value has a group of instances, one for each rule that applies
+  to it: the rules picked by the containing array or object instances
+  plus those they bring in with allOf, anyOf, oneOf, not and $ref.
+  Groups are kept on a stack (instances), a container's group stays 
+  until it closes. A failure passes up at once through instances that
+  fail with their child (MEMBER, ALL), so an invalid document stops 
+  the scan at the value that made it invalid. anyOf, oneOf and not are
+  settled when the value ends.
+*/
+class cjson::Schema::Check
+{
+public:
+	// keys passed to onKey must be copied unless they stay valid until 
+	// the object ends (they do when checking a node)
+	Check(const Program& Compiled, bool CopyKeys = true);
+
+	bool onStartObject();
+	bool onEndObject();
+	bool onStartArray();
+	bool onEndArray();
+	bool onKey(const char* Text, size_t Length);
+	bool onString(const char* Text, size_t Length);
+	bool onInt(int64_t Value);
+	bool onDouble(double Value);
+	bool onBool(bool Value);
+	bool onNull();
+
+	// emit the events for a node and it's members
+	bool node(cjson* N);
+
+	// a complete value was read and it passed
+	bool passed() { return complete && !stopped; }
+	const std::string& error() { return failure; }
+	// hash of the last complete top level value (with Program::hashing)
+	uint64_t valueHash() { return rootHash; }
+
+	~Check();
+
+private:
+	enum { ROOT, MEMBER, ALL, ANY, ONE, NOT };
+
+	struct Instance
+	{
+		int rule;
+		int parent;
+		int role;
+		bool failed;
+		int anyPassed;
+		int onePassed;
+		size_t seen; // required property bits in bits
+	};
+
+	struct Frame
+	{
+		bool object;
+		size_t first; // instances [first, end) are for this container
+		size_t end;
+		int64_t count;
+		uint64_t hash; // arrays, objects sum member hashes into it
+		const char* key;
+		size_t keyLength;
+		std::string keyCopy;
+		uint64_t keyHash;
+		size_t bitsMark;
+		size_t hashesMark;
+		bool keyed;  // an instance has properties, keys are hashed
+		bool hashed; // member hashes are needed
+		bool unique;
+	};
+
+	const Program& program;
+	bool copyKeys;
+	std::vector< Instance > instances;
+	std::vector< Frame > frames; // open containers, frames[0, top)
+	size_t top;
+	std::vector< uint64_t > bits;
+	std::vector< uint64_t > itemHashes;
+	size_t depth; // frames that contain the value being checked
+	bool stopped;
+	bool complete;
+	uint64_t rootHash;
+	std::string failure;
+
+	// values are compared by hash, a match is confirmed against the 
+	// value itself. Scalars are kept in finished, arrays and objects 
+	// that need it are copied into capture as they are read.
+	struct Finished
+	{
+		cjsonType type;
+		int64_t integer;
+		double number;
+		const char* text;
+		size_t length;
+		cjson* node; // in capture, for arrays and objects
+	};
+
+	Finished finished;
+	Builder capture;
+
+	void add(int Rule, int Parent, int Role, int Expand);
+	size_t begin();
+	bool hashes(size_t First);
+	bool end(size_t First, uint64_t Hash);
+	void fail(size_t Index, const char* Keyword, const char* Detail = NULL);
+	void stop(const char* Keyword, const char* Detail);
+	void types(size_t First, unsigned Types);
+	void number(size_t First, double Value, int64_t Int, bool IsInt);
+	void container(bool Object, size_t First, bool Hashed);
+	cjson* closeCapture(bool Object);
+	void releaseCapture(cjson* Closed);
+	void scalar(cjsonType Type, int64_t Integer, double Number, const char* Text, size_t Length);
+	bool matches(cjson* Literal);
+	bool duplicates(size_t First, cjson* Array);
+};
+
+// value hashes for enum, const and uniqueItems. Integral doubles
+// hash as integers so 1.0 matches 1
+__forceinline uint64_t schemaHashInt(int64_t Value)
+{
+	return hashMix(hashMix(SCHEMA_INTEGER) ^ (uint64_t)Value);
+}
+
+__forceinline uint64_t schemaHashDouble(double Value)
+{
+	if (Value == floor(Value) && Value >= -9.2e18 && Value <= 9.2e18)
+		return schemaHashInt((int64_t)Value);
+
+	uint64_t bits;
+	memcpy(&bits, &Value, sizeof(bits));
+	return hashMix(hashMix(SCHEMA_NUMBER) ^ bits);
+}
+
+// an integer and a double are the same number when the double is 
+// integral (see schemaHashDouble)
+__forceinline bool schemaSameNumber(int64_t Int, double Dbl)
+{
+	return Dbl == floor(Dbl) && Dbl >= -9.2e18 && Dbl <= 9.2e18 && (int64_t)Dbl == Int;
+}
+
+// exact equality for enum, const and uniqueItems, numbers are equal 
+// by value (1.0 is 1) and object members can be in any order
+static bool schemaEquals(cjson* A, cjson* B)
+{
+	int64_t intA, intB;
+	double dblA, dblB;
+
+	if (A->isInt(intA))
+		return (B->isInt(intB)) ? intA == intB : B->isDouble(dblB) && schemaSameNumber(intA, dblB);
+
+	if (A->isDouble(dblA))
+		return (B->isInt(intB)) ? schemaSameNumber(intB, dblA) : B->isDouble(dblB) && dblA == dblB;
+
+	if (A->type() != B->type())
+		return false;
+
+	switch (A->type())
+	{
+	case cjsonType::BOOL:
+	{
+		bool a = false, b = false;
+		A->isBool(a);
+		B->isBool(b);
+		return a == b;
+	}
+	case cjsonType::STR:
+	{
+		char* a;
+		char* b;
+		A->isStringCstr(a);
+		B->isStringCstr(b);
+		return strcmp(a, b) == 0;
+	}
+	case cjsonType::ARRAY:
+	{
+		std::vector< cjson* > a = A->getNodes();
+		std::vector< cjson* > b = B->getNodes();
+
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+			if (!schemaEquals(a[i], b[i]))
+				return false;
+
+		return true;
+	}
+	case cjsonType::OBJECT:
+	{
+		std::vector< cjson* > a = A->getNodes();
+
+		if (a.size() != B->getNodes().size())
+			return false;
+
+		for (cjson* member : a)
+		{
+			cjson* other = B->find(memberName(member));
+
+			if (!other || !schemaEquals(member, other))
+				return false;
+		}
+
+		return true;
+	}
+	default:
+		return true;
+	}
+}
+
+cjson::Schema::Check::Check(const Program& Compiled, bool CopyKeys) :
+	program(Compiled),
+	copyKeys(CopyKeys),
+	top(0),
+	depth(0),
+	stopped(false),
+	complete(false),
+	rootHash(0)
+{
+	instances.reserve(64);
+	frames.resize(16);
+	finished.node = NULL;
+}
+
+cjson::Schema::Check::~Check()
+{
+	// stopped part way through a captured value
+	if (capture.root)
+		cjson::DisposeDocument(capture.root);
+}
+
+// the value being finished is a scalar
+void cjson::Schema::Check::scalar(cjsonType Type, int64_t Integer, double Number, const char* Text, size_t Length)
+{
+	finished.type = Type;
+	finished.integer = Integer;
+	finished.number = Number;
+	finished.text = Text;
+	finished.length = Length;
+	finished.node = NULL;
+}
+
+// true if the value being finished equals Literal (an enum or const 
+// value), called when their hashes match
+bool cjson::Schema::Check::matches(cjson* Literal)
+{
+	if (finished.node)
+		return schemaEquals(finished.node, Literal);
+
+	int64_t integer;
+	double number;
+	bool boolean;
+	char* text;
+
+	switch (finished.type)
+	{
+	case cjsonType::INT:
+		if (Literal->isInt(integer))
+			return integer == finished.integer;
+		return Literal->isDouble(number) && schemaSameNumber(finished.integer, number);
+	case cjsonType::DBL:
+		if (Literal->isInt(integer))
+			return schemaSameNumber(integer, finished.number);
+		return Literal->isDouble(number) && number == finished.number;
+	case cjsonType::BOOL:
+		return Literal->isBool(boolean) && boolean == (finished.integer != 0);
+	case cjsonType::STR:
+		return Literal->isStringCstr(text) && strlen(text) == finished.length && 
+			memcmp(text, finished.text, finished.length) == 0;
+	default:
+		return Literal->type() == cjsonType::NUL;
+	}
+}
+
+// close the captured copy of an array or object (if there is one) and
+// return it
+cjson* cjson::Schema::Check::closeCapture(bool Object)
+{
+	if (!capture.current)
+		return NULL;
+
+	cjson* closed = capture.current;
+
+	if (Object)
+		capture.onEndObject();
+	else
+		capture.onEndArray();
+
+	return closed;
+}
+
+// done with a closed value, the capture is disposed when it's outer 
+// value closes
+void cjson::Schema::Check::releaseCapture(cjson* Closed)
+{
+	finished.node = NULL;
+
+	if (Closed && Closed == capture.root)
+	{
+		cjson::DisposeDocument(capture.root);
+		capture.root = NULL;
+	}
+}
+
+// true if two items of Array (the captured copy) are equal, hashes 
+// pick out the candidates and schemaEquals confirms them
+bool cjson::Schema::Check::duplicates(size_t First, cjson* Array)
+{
+	size_t count = itemHashes.size() - First;
+	std::vector< size_t > order(count);
+
+	for (size_t i = 0; i < count; i++)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(), [&](size_t A, size_t B) { 
+		return itemHashes[First + A] < itemHashes[First + B]; 
+	});
+
+	std::vector< cjson* > items;
+
+	if (Array)
+		items = Array->getNodes();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t hash = itemHashes[First + order[i]];
+
+		for (size_t j = i + 1; j < count && itemHashes[First + order[j]] == hash; j++)
+		{
+			if (items.size() != count || schemaEquals(items[order[i]], items[order[j]]))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void cjson::Schema::Check::add(int Rule, int Parent, int Role, int Expand)
+{
+	size_t index = instances.size();
+	Instance instance = { Rule, Parent, Role, false, 0, 0, 0 };
+	instances.push_back(instance);
+
+	if (Expand > schemaMaxExpand)
+	{
+		fail(index, "$ref");
+		return;
+	}
+
+	const Program::Rule& rule = program.rules[Rule];
+
+	for (int i = 0; i < rule.allCount; i++)
+		add(program.lists[rule.allFirst + i], (int)index, ALL, Expand + 1);
+	for (int i = 0; i < rule.anyCount; i++)
+		add(program.lists[rule.anyFirst + i], (int)index, ANY, Expand + 1);
+	for (int i = 0; i < rule.oneCount; i++)
+		add(program.lists[rule.oneFirst + i], (int)index, ONE, Expand + 1);
+	if (rule.notRule != -1)
+		add(rule.notRule, (int)index, NOT, Expand + 1);
+}
+
+// start a value, adds the instances for it and returns where they start
+size_t cjson::Schema::Check::begin()
+{
+	size_t first = instances.size();
+	depth = top;
+
+	if (!top)
+	{
+		add(program.root, -1, ROOT, 0);
+		return first;
+	}
+
+	Frame& frame = frames[top - 1];
+	int64_t index = frame.count++;
+
+	for (size_t i = frame.first; i < frame.end; i++)
+	{
+		if (instances[i].failed)
+			continue;
+
+		const Program::Rule& rule = program.rules[instances[i].rule];
+		int child;
+
+		if (frame.object)
+		{
+			const Program::Property* property = program.find(rule, frame.key, frame.keyLength, frame.keyHash);
+			child = rule.additional;
+
+			if (property)
+			{
+				if (property->required != -1)
+					bits[instances[i].seen + (property->required >> 6)] |= (uint64_t)1 << (property->required & 63);
+
+				if (property->rule != -1)
+					child = property->rule;
+			}
+		}
+		else if (rule.tupleCount)
+			child = (index < rule.tupleCount) ? program.lists[rule.tupleFirst + index] : rule.additionalItems;
+		else
+			child = rule.items;
+
+		if (child != -1)
+			add(child, (int)i, MEMBER, 0);
+	}
+
+	return first;
+}
+
+// true if the hash of the value starting at First is needed, for enum 
+// or const or for the container it's in
+bool cjson::Schema::Check::hashes(size_t First)
+{
+	if (program.hashing || (top && frames[top - 1].hashed))
+		return true;
+
+	if (program.enums.empty())
+		return false;
+
+	for (size_t i = First; i < instances.size(); i++)
+		if (program.rules[instances[i].rule].enumCount)
+			return true;
+
+	return false;
+}
+
+void cjson::Schema::Check::fail(size_t Index, const char* Keyword, const char* Detail)
+{
+	while (!instances[Index].failed)
+	{
+		Instance& instance = instances[Index];
+		instance.failed = true;
+
+		if (instance.role == ROOT)
+		{
+			stop(Keyword, Detail);
+			return;
+		}
+
+		if (instance.role != MEMBER && instance.role != ALL)
+			return;
+
+		Index = instance.parent;
+	}
+}
+
+// the document fails at the current value, whatever the instances
+// (not, anyOf, oneOf) would make of it
+void cjson::Schema::Check::stop(const char* Keyword, const char* Detail)
+{
+	failure.clear();
+
+	for (size_t i = 0; i < depth; i++)
+	{
+		if (frames[i].object)
+			pointerAppend(failure, std::string(frames[i].key, frames[i].keyLength).c_str());
+		else
+			pointerAppend(failure, (size_t)(frames[i].count - 1));
+	}
+
+	if (!failure.empty())
+		failure += ": ";
+
+	failure += Keyword;
+
+	if (Detail)
+	{
+		failure += " ";
+		failure += Detail;
+	}
+
+	stopped = true;
+}
+
+void cjson::Schema::Check::types(size_t First, unsigned Types)
+{
+	for (size_t i = First; i < instances.size(); i++)
+		if (!instances[i].failed && !(program.rules[instances[i].rule].types & Types))
+			fail(i, "type");
+}
+
+// finish the value whose instances start at First, settles anyOf,
+// oneOf and not then passes the value hash to the container
+bool cjson::Schema::Check::end(size_t First, uint64_t Hash)
+{
+	for (size_t i = instances.size(); i-- > First;)
+	{
+		const Program::Rule& rule = program.rules[instances[i].rule];
+
+		if (rule.enumCount && !instances[i].failed)
+		{
+			bool found = false;
+
+			for (int e = rule.enumFirst; e < rule.enumFirst + rule.enumCount && !found; e++)
+				found = program.enums[e] == Hash && matches(program.literals[e]);
+
+			if (!found)
+				fail(i, (rule.isConst) ? "const" : "enum");
+		}
+
+		if (!instances[i].failed)
+		{
+			if (rule.anyCount && !instances[i].anyPassed)
+				fail(i, "anyOf");
+			else if (rule.oneCount && instances[i].onePassed != 1)
+				fail(i, "oneOf");
+		}
+
+		Instance& instance = instances[i];
+
+		if (instance.failed)
+			continue;
+
+		switch (instance.role)
+		{
+		case ANY:
+			instances[instance.parent].anyPassed++;
+			break;
+		case ONE:
+			instances[instance.parent].onePassed++;
+			break;
+		case NOT:
+			fail(instance.parent, "not");
+			break;
+		}
+	}
+
+	instances.resize(First);
+
+	if (!top)
+	{
+		complete = true;
+		rootHash = Hash;
+	}
+	else if (frames[top - 1].hashed)
+	{
+		Frame& frame = frames[top - 1];
+
+		if (frame.object)
+			frame.hash += hashMix(frame.keyHash ^ Hash);
+		else
+		{
+			frame.hash = hashMix(frame.hash ^ Hash);
+
+			if (frame.unique)
+				itemHashes.push_back(Hash);
+		}
+	}
+
+	return !stopped;
+}
+
+void cjson::Schema::Check::number(size_t First, double Value, int64_t Int, bool IsInt)
+{
+	for (size_t i = First; i < instances.size(); i++)
+	{
+		const Program::Rule& rule = program.rules[instances[i].rule];
+
+		if (!rule.limits || instances[i].failed)
+			continue;
+
+		if ((rule.limits & LIMIT_MINIMUM) && Value < rule.minimum)
+			fail(i, "minimum");
+		else if ((rule.limits & LIMIT_EXCLUSIVE_MINIMUM) && Value <= rule.exclusiveMinimum)
+			fail(i, "exclusiveMinimum");
+		else if ((rule.limits & LIMIT_MAXIMUM) && Value > rule.maximum)
+			fail(i, "maximum");
+		else if ((rule.limits & LIMIT_EXCLUSIVE_MAXIMUM) && Value >= rule.exclusiveMaximum)
+			fail(i, "exclusiveMaximum");
+		else if (rule.limits & LIMIT_MULTIPLE_OF)
+		{
+			bool multiple;
+
+			if (IsInt && rule.multipleOf == floor(rule.multipleOf) && rule.multipleOf < 9.2e18)
+				multiple = (Int % (int64_t)rule.multipleOf) == 0;
+			else
+			{
+				double quotient = Value / rule.multipleOf;
+				multiple = fabs(quotient - floor(quotient + 0.5)) <= 1e-9 * std::max(1.0, fabs(quotient));
+			}
+
+			if (!multiple)
+				fail(i, "multipleOf");
+		}
+	}
+}
+
+bool cjson::Schema::Check::onInt(int64_t Value)
+{
+	size_t first = begin();
+
+	types(first, SCHEMA_NUMBER | SCHEMA_INTEGER);
+	number(first, (double)Value, Value, true);
+
+	if (capture.current)
+		capture.onInt(Value);
+
+	scalar(cjsonType::INT, Value, 0, NULL, 0);
+	return end(first, (hashes(first)) ? schemaHashInt(Value) : 0);
+}
+
+bool cjson::Schema::Check::onDouble(double Value)
+{
+	size_t first = begin();
+
+	types(first, (Value == floor(Value)) ? SCHEMA_NUMBER | SCHEMA_INTEGER : SCHEMA_NUMBER);
+	number(first, Value, 0, false);
+
+	if (capture.current)
+		capture.onDouble(Value);
+
+	scalar(cjsonType::DBL, 0, Value, NULL, 0);
+	return end(first, (hashes(first)) ? schemaHashDouble(Value) : 0);
+}
+
+bool cjson::Schema::Check::onBool(bool Value)
+{
+	size_t first = begin();
+
+	types(first, SCHEMA_BOOLEAN);
+
+	if (capture.current)
+		capture.onBool(Value);
+
+	scalar(cjsonType::BOOL, Value, 0, NULL, 0);
+	return end(first, hashMix(hashMix(SCHEMA_BOOLEAN) ^ (Value ? 1 : 2)));
+}
+
+bool cjson::Schema::Check::onNull()
+{
+	size_t first = begin();
+
+	types(first, SCHEMA_NULL);
+
+	if (capture.current)
+		capture.onNull();
+
+	scalar(cjsonType::NUL, 0, 0, NULL, 0);
+	return end(first, hashMix(SCHEMA_NULL));
+}
+
+bool cjson::Schema::Check::onString(const char* Text, size_t Length)
+{
+	size_t first = begin();
+	int64_t characters = -1;
+
+	types(first, SCHEMA_STRING);
+
+	for (size_t i = first; i < instances.size(); i++)
+	{
+		const Program::Rule& rule = program.rules[instances[i].rule];
+
+		if (instances[i].failed || (!rule.minLength && rule.maxLength == -1 && rule.pattern == -1))
+			continue;
+
+		// lengths are in characters (code points), not bytes
+		if (characters == -1)
+		{
+			characters = 0;
+
+			for (size_t c = 0; c < Length; c++)
+				if ((Text[c] & 0xC0) != 0x80)
+					++characters;
+		}
+
+		if (characters < rule.minLength)
+			fail(i, "minLength");
+		else if (rule.maxLength != -1 && characters > rule.maxLength)
+			fail(i, "maxLength");
+		else if (rule.pattern != -1 && Length > schemaMaxPatternLength)
+		{
+			// a failed pattern could pass under not, so don't guess
+			stop("pattern", "(string too long to match)");
+			return false;
+		}
+		else if (rule.pattern != -1 && !std::regex_search(Text, Text + Length, program.patterns[rule.pattern]))
+			fail(i, "pattern");
+	}
+
+	if (capture.current)
+		capture.onString(Text, Length);
+
+	scalar(cjsonType::STR, 0, 0, Text, Length);
+	return end(first, (hashes(first)) ? hashText(hashMix(SCHEMA_STRING), Text, Length) : 0);
+}
+
+// open an array or object whose instances start at First, Hashed if 
+// it's own hash is needed
+void cjson::Schema::Check::container(bool Object, size_t First, bool Hashed)
+{
+	if (top == frames.size())
+		frames.resize(top * 2);
+
+	Frame& frame = frames[top++];
+	frame.object = Object;
+	frame.first = First;
+	frame.end = instances.size();
+	frame.count = 0;
+	frame.hash = (Object) ? 0 : hashMix(SCHEMA_ARRAY);
+	frame.bitsMark = bits.size();
+	frame.hashesMark = itemHashes.size();
+	frame.keyed = false;
+	frame.hashed = Hashed;
+	frame.unique = false;
+
+	for (size_t i = First; i < frame.end; i++)
+	{
+		const Program::Rule& rule = program.rules[instances[i].rule];
+
+		if (Object && rule.required)
+		{
+			instances[i].seen = bits.size();
+			bits.resize(bits.size() + ((rule.propertyCount + 63) >> 6), 0);
+		}
+
+		if (rule.propertyCount)
+			frame.keyed = true;
+
+		if (rule.unique)
+			frame.unique = frame.hashed = true;
+	}
+
+	// copy it if it's hash is needed (or it's in a copied value), 
+	// Program::hashing only wants the hash
+	if (capture.current || (frame.hashed && !program.hashing))
+		capture.container((Object) ? cjsonType::OBJECT : cjsonType::ARRAY);
+}
+
+bool cjson::Schema::Check::onStartObject()
+{
+	size_t first = begin();
+
+	types(first, SCHEMA_OBJECT);
+	container(true, first, hashes(first));
+
+	return !stopped;
+}
+
+bool cjson::Schema::Check::onStartArray()
+{
+	size_t first = begin();
+
+	types(first, SCHEMA_ARRAY);
+	container(false, first, hashes(first));
+
+	return !stopped;
+}
+
+bool cjson::Schema::Check::onKey(const char* Text, size_t Length)
+{
+	Frame& frame = frames[top - 1];
+
+	if (capture.current)
+		capture.onKey(Text, Length);
+
+	if (copyKeys)
+	{
+		frame.keyCopy.assign(Text, Length);
+		Text = frame.keyCopy.data();
+	}
+
+	frame.key = Text;
+	frame.keyLength = Length;
+
+	if (frame.keyed || frame.hashed)
+		frame.keyHash = hashText(0, Text, Length);
+
+	// count is advanced by begin
+	return true;
+}
+
+bool cjson::Schema::Check::onEndObject()
+{
+	Frame& frame = frames[top - 1];
+	depth = top - 1;
+
+	for (size_t i = frame.first; i < frame.end; i++)
+	{
+		const Program::Rule& rule = program.rules[instances[i].rule];
+
+		if (instances[i].failed)
+			continue;
+
+		if (frame.count < rule.minProperties)
+			fail(i, "minProperties");
+		else if (rule.maxProperties != -1 && frame.count > rule.maxProperties)
+			fail(i, "maxProperties");
+		else if (rule.required)
+		{
+			for (int p = 0; p < rule.propertyCount; p++)
+			{
+				const Program::Property& property = program.properties[rule.propertyFirst + p];
+
+				if (property.required != -1 &&
+					!(bits[instances[i].seen + (property.required >> 6)] & ((uint64_t)1 << (property.required & 63))))
+				{
+					fail(i, "required", program.names.c_str() + property.name);
+					break;
+				}
+			}
+		}
+	}
+
+	bits.resize(frame.bitsMark);
+	--top;
+
+	cjson* closed = closeCapture(true);
+	finished.node = closed;
+
+	bool more = end(frame.first, hashMix(hashMix(SCHEMA_OBJECT) ^ frame.hash));
+	releaseCapture(closed);
+	return more;
+}
+
+bool cjson::Schema::Check::onEndArray()
+{
+	Frame& frame = frames[top - 1];
+	depth = top - 1;
+
+	cjson* closed = closeCapture(false);
+	bool repeated = false;
+
+	if (frame.unique)
+	{
+		repeated = duplicates(frame.hashesMark, closed);
+		itemHashes.resize(frame.hashesMark);
+	}
+
+	for (size_t i = frame.first; i < frame.end; i++)
+	{
+		const Program::Rule& rule = program.rules[instances[i].rule];
+
+		if (instances[i].failed)
+			continue;
+
+		if (frame.count < rule.minItems)
+			fail(i, "minItems");
+		else if (rule.maxItems != -1 && frame.count > rule.maxItems)
+			fail(i, "maxItems");
+		else if (rule.unique && repeated)
+			fail(i, "uniqueItems");
+	}
+
+	--top;
+
+	finished.node = closed;
+
+	bool more = end(frame.first, frame.hash);
+	releaseCapture(closed);
+	return more;
+}
+
+bool cjson::Schema::Check::node(cjson* N)
+{
+	switch (N->nodeType)
+	{
+	case cjsonType::OBJECT:
+		if (!onStartObject())
+			return false;
+
+		for (cjson* n = N->membersHead; n; n = n->siblingNext)
+		{
+			if (n->nodeType == cjsonType::VOIDED)
+				continue;
+
+			const char* name = memberName(n);
+
+			if (!onKey(name, strlen(name)) || !node(n))
+				return false;
+		}
+
+		return onEndObject();
+	case cjsonType::ARRAY:
+		if (!onStartArray())
+			return false;
+
+		for (cjson* n = N->membersHead; n; n = n->siblingNext)
+			if (n->nodeType != cjsonType::VOIDED && !node(n))
+				return false;
+
+		return onEndArray();
+	case cjsonType::INT:
+		return onInt((N->nodeData) ? N->nodeData->asInt : 0);
+	case cjsonType::DBL:
+		return onDouble((N->nodeData) ? N->nodeData->asDouble : 0);
+	case cjsonType::BOOL:
+		return onBool((N->nodeData) ? N->nodeData->asBool : false);
+	case cjsonType::STR:
+		if (N->nodeData)
+			return onString(&N->nodeData->asStr, strlen(&N->nodeData->asStr));
+		return onString("", 0);
+	default:
+		return onNull();
+	}
+}
+
+struct cjson::Schema::Compiler
+{
+	Program& program;
+	cjson* document;
+	std::string error;
+	std::unordered_map< cjson*, int > compiled;
+
+	Compiler(Program& Target, cjson* Document) :
+		program(Target),
+		document(Document)
+	{}
+
+	// Path is the JSON Pointer of the schema, Keyword (if any) is the 
+	// keyword in it with the problem
+	bool fail(const std::string& Path, const char* Keyword, const char* Problem)
+	{
+		if (error.empty())
+		{
+			error = Path + ((*Keyword) ? "/" : "") + Keyword;
+			error += (error.empty()) ? Problem : std::string(": ") + Problem;
+		}
+
+		return false;
+	}
+
+	// read a count (non negative integer) keyword
+	bool count(cjson* S, const std::string& Path, const char* Keyword, int64_t& Value)
+	{
+		cjson* n = S->find(Keyword);
+		double dbl;
+
+		if (!n)
+			return true;
+
+		if (n->isDouble(dbl) && dbl == floor(dbl))
+			Value = (int64_t)dbl;
+		else if (!n->isInt(Value))
+			return fail(Path, Keyword, "expected an integer");
+
+		if (Value < 0)
+			return fail(Path, Keyword, "must not be negative");
+
+		return true;
+	}
+
+	// read a number keyword, returns true if it's there
+	bool number(cjson* S, const std::string& Path, const char* Keyword, double& Value)
+	{
+		cjson* n = S->find(Keyword);
+		int64_t Int;
+
+		if (!n)
+			return false;
+
+		if (n->isInt(Int))
+			Value = (double)Int;
+		else if (!n->isDouble(Value))
+			return fail(Path, Keyword, "expected a number");
+
+		return true;
+	}
+
+	unsigned type(const char* Name)
+	{
+		static const char* const names[] = { "null", "boolean", "object", "array", "string", "number", "integer" };
+
+		for (int i = 0; i < 7; i++)
+			if (strcmp(Name, names[i]) == 0)
+				return 1 << i;
+
+		return 0;
+	}
+
+	bool types(cjson* S, const std::string& Path, unsigned& Types)
+	{
+		cjson* n = S->find("type");
+		char* name;
+
+		if (!n)
+			return true;
+
+		if (n->isStringCstr(name))
+		{
+			Types = type(name);
+			return (Types) ? true : fail(Path, "type", "unknown type");
+		}
+
+		if (n->type() != cjsonType::ARRAY)
+			return fail(Path, "type", "expected a string or an array");
+
+		Types = 0;
+
+		for (cjson* t = n->membersHead; t; t = t->siblingNext)
+		{
+			if (t->nodeType == cjsonType::VOIDED)
+				continue;
+
+			unsigned bit = (t->isStringCstr(name)) ? type(name) : 0;
+
+			if (!bit)
+				return fail(Path, "type", "unknown type");
+
+			Types |= bit;
+		}
+
+		return true;
+	}
+
+	// compile the schemas in an array keyword (allOf, items, ...) into 
+	// Program::lists, returns false if it's there but isn't an array
+	bool list(cjson* S, const std::string& Path, const char* Keyword, int& First, int& Count)
+	{
+		cjson* n = S->find(Keyword);
+		std::vector< int > members;
+
+		if (!n)
+			return true;
+
+		if (n->type() != cjsonType::ARRAY || !n->size())
+			return fail(Path, Keyword, "expected an array of schemas");
+
+		size_t index = 0;
+
+		for (cjson* m = n->membersHead; m; m = m->siblingNext)
+		{
+			if (m->nodeType == cjsonType::VOIDED)
+				continue;
+
+			std::string path = Path + "/" + Keyword;
+			pointerAppend(path, index++);
+
+			int child = rule(m, path);
+
+			if (child == -1)
+				return false;
+
+			members.push_back(child);
+		}
+
+		First = (int)program.lists.size();
+		Count = (int)members.size();
+		program.lists.insert(program.lists.end(), members.begin(), members.end());
+		return true;
+	}
+
+	// compile a schema keyword, returns false if it's there and bad
+	bool child(cjson* S, const std::string& Path, const char* Keyword, int& Rule)
+	{
+		cjson* n = S->find(Keyword);
+
+		if (!n)
+			return true;
+
+		Rule = rule(n, Path + "/" + Keyword);
+		return (Rule != -1);
+	}
+
+	// the hash of an enum or const value, see Check::valueHash
+	uint64_t hash(cjson* Value)
+	{
+		Program any;
+		any.rules.resize(1);
+		any.hashing = true;
+
+		Check check(any, false);
+		check.node(Value);
+		return check.valueHash();
+	}
+
+	// a copy of an enum or const value, hash matches are confirmed 
+	// against it
+	cjson* literal(cjson* Value)
+	{
+		if (!program.literalDocument)
+			program.literalDocument = cjson::MakeDocument();
+
+		return cjson::Clone(Value, program.literalDocument);
+	}
+
+	bool properties(cjson* S, const std::string& Path, int Index)
+	{
+		cjson* props = S->find("properties");
+		cjson* required = S->find("required");
+		std::vector< Program::Property > table;
+
+		if (props && props->type() != cjsonType::OBJECT)
+			return fail(Path, "properties", "expected an object");
+
+		if (required && required->type() != cjsonType::ARRAY)
+			return fail(Path, "required", "expected an array of names");
+
+		for (cjson* p = (props) ? props->membersHead.get() : NULL; p; p = p->siblingNext)
+		{
+			if (p->nodeType == cjsonType::VOIDED)
+				continue;
+
+			std::string path = Path + "/properties";
+			pointerAppend(path, memberName(p));
+
+			int child = rule(p, path);
+
+			if (child == -1)
+				return false;
+
+			const char* name = memberName(p);
+			Program::Property property = { hashText(0, name, strlen(name)), program.names.size(), strlen(name), child, -1 };
+			program.names.append(name, strlen(name) + 1);
+			table.push_back(property);
+		}
+
+		int requiredCount = 0;
+
+		for (cjson* r = (required) ? required->membersHead.get() : NULL; r; r = r->siblingNext)
+		{
+			char* name;
+
+			if (r->nodeType == cjsonType::VOIDED)
+				continue;
+
+			if (!r->isStringCstr(name))
+				return fail(Path, "required", "expected an array of names");
+
+			size_t length = strlen(name);
+			Program::Property* property = NULL;
+
+			for (size_t i = 0; i < table.size(); i++)
+				if (table[i].length == length && memcmp(program.names.data() + table[i].name, name, length) == 0)
+					property = &table[i];
+
+			if (!property)
+			{
+				Program::Property only = { hashText(0, name, length), program.names.size(), length, -1, -1 };
+				program.names.append(name, length + 1);
+				table.push_back(only);
+				property = &table.back();
+			}
+
+			if (property->required == -1)
+				property->required = requiredCount++;
+		}
+
+		if (table.empty())
+			return true;
+
+		// open addressed slots, at least half empty
+		int size = 4;
+
+		while (size < (int)table.size() * 2)
+			size <<= 1;
+
+		Program::Rule& rule = program.rules[Index];
+		rule.propertyFirst = (int)program.properties.size();
+		rule.propertyCount = (int)table.size();
+		rule.slotFirst = (int)program.slots.size();
+		rule.slotMask = size - 1;
+		rule.required = requiredCount;
+
+		program.slots.resize(program.slots.size() + size, -1);
+
+		for (size_t i = 0; i < table.size(); i++)
+		{
+			int slot = table[i].hash & rule.slotMask;
+
+			while (program.slots[rule.slotFirst + slot] != -1)
+				slot = (slot + 1) & rule.slotMask;
+
+			program.slots[rule.slotFirst + slot] = rule.propertyFirst + (int)i;
+		}
+
+		program.properties.insert(program.properties.end(), table.begin(), table.end());
+		return true;
+	}
+
+	// compile schema S, returns it's rule or -1
+	int rule(cjson* S, const std::string& Path)
+	{
+		std::unordered_map< cjson*, int >::iterator found = compiled.find(S);
+
+		if (found != compiled.end())
+			return found->second;
+
+		int index = (int)program.rules.size();
+		program.rules.push_back(Program::Rule());
+		compiled[S] = index;
+
+		bool boolean;
+
+		if (S->isBool(boolean))
+		{
+			if (!boolean)
+				program.rules[index].types = 0;
+			return index;
+		}
+
+		if (S->type() != cjsonType::OBJECT)
+		{
+			fail(Path, "", "expected a schema (object or boolean)");
+			return -1;
+		}
+
+		// the rule is filled in on a copy because compiling sub schemas 
+		// grows program.rules
+		Program::Rule rule;
+		char* text;
+
+		if (!types(S, Path, rule.types))
+			return -1;
+
+		if (number(S, Path, "minimum", rule.minimum))
+			rule.limits |= LIMIT_MINIMUM;
+		if (number(S, Path, "maximum", rule.maximum))
+			rule.limits |= LIMIT_MAXIMUM;
+
+		// draft 4 exclusiveMinimum/exclusiveMaximum are booleans that
+		// modify minimum and maximum
+		cjson* exclusive = S->find("exclusiveMinimum");
+
+		if (exclusive && exclusive->isBool(boolean))
+		{
+			if (boolean && (rule.limits & LIMIT_MINIMUM))
+			{
+				rule.limits = (rule.limits & ~LIMIT_MINIMUM) | LIMIT_EXCLUSIVE_MINIMUM;
+				rule.exclusiveMinimum = rule.minimum;
+			}
+		}
+		else if (number(S, Path, "exclusiveMinimum", rule.exclusiveMinimum))
+			rule.limits |= LIMIT_EXCLUSIVE_MINIMUM;
+
+		exclusive = S->find("exclusiveMaximum");
+
+		if (exclusive && exclusive->isBool(boolean))
+		{
+			if (boolean && (rule.limits & LIMIT_MAXIMUM))
+			{
+				rule.limits = (rule.limits & ~LIMIT_MAXIMUM) | LIMIT_EXCLUSIVE_MAXIMUM;
+				rule.exclusiveMaximum = rule.maximum;
+			}
+		}
+		else if (number(S, Path, "exclusiveMaximum", rule.exclusiveMaximum))
+			rule.limits |= LIMIT_EXCLUSIVE_MAXIMUM;
+
+		if (number(S, Path, "multipleOf", rule.multipleOf))
+		{
+			if (rule.multipleOf <= 0)
+			{
+				fail(Path, "multipleOf", "must be greater than 0");
+				return -1;
+			}
+
+			rule.limits |= LIMIT_MULTIPLE_OF;
+		}
+
+		if (!error.empty())
+			return -1;
+
+		if (!count(S, Path, "minLength", rule.minLength) ||
+			!count(S, Path, "maxLength", rule.maxLength) ||
+			!count(S, Path, "minItems", rule.minItems) ||
+			!count(S, Path, "maxItems", rule.maxItems) ||
+			!count(S, Path, "minProperties", rule.minProperties) ||
+			!count(S, Path, "maxProperties", rule.maxProperties))
+			return -1;
+
+		cjson* n = S->find("pattern");
+
+		if (n)
+		{
+			if (!n->isStringCstr(text))
+			{
+				fail(Path, "pattern", "expected a string");
+				return -1;
+			}
+
+			try
+			{
+				program.patterns.push_back(std::regex(text, std::regex::ECMAScript | std::regex::optimize));
+			}
+			catch (const std::regex_error&)
+			{
+				fail(Path, "pattern", "invalid regular expression");
+				return -1;
+			}
+
+			rule.pattern = (int)program.patterns.size() - 1;
+		}
+
+		n = S->find("uniqueItems");
+
+		if (n)
+			n->isBool(rule.unique);
+
+		// values in enum and const are compared by hash, matches are 
+		// confirmed against a copy of the value
+		std::vector< uint64_t > values;
+		std::vector< cjson* > literals;
+
+		n = S->find("enum");
+
+		if (n)
+		{
+			if (n->type() != cjsonType::ARRAY)
+			{
+				fail(Path, "enum", "expected an array");
+				return -1;
+			}
+
+			for (cjson* v = n->membersHead; v; v = v->siblingNext)
+			{
+				if (v->nodeType != cjsonType::VOIDED)
+				{
+					values.push_back(hash(v));
+					literals.push_back(literal(v));
+				}
+			}
+		}
+		else if ((n = S->find("const")) != NULL)
+		{
+			values.push_back(hash(n));
+			literals.push_back(literal(n));
+			rule.isConst = true;
+		}
+
+		if (n)
+		{
+			rule.enumFirst = (int)program.enums.size();
+			rule.enumCount = (int)values.size();
+			program.enums.insert(program.enums.end(), values.begin(), values.end());
+			program.literals.insert(program.literals.end(), literals.begin(), literals.end());
+
+			// an empty enum allows nothing
+			if (values.empty())
+				rule.types = 0;
+		}
+
+		// "prefixItems" + "items" (2020-12) or "items": [ ... ] + 
+		// "additionalItems" (earlier drafts) or "items": schema
+		n = S->find("items");
+
+		if (S->find("prefixItems"))
+		{
+			if (!list(S, Path, "prefixItems", rule.tupleFirst, rule.tupleCount) ||
+				!child(S, Path, "items", rule.additionalItems))
+				return -1;
+		}
+		else if (n && n->type() == cjsonType::ARRAY)
+		{
+			if (!list(S, Path, "items", rule.tupleFirst, rule.tupleCount) ||
+				!child(S, Path, "additionalItems", rule.additionalItems))
+				return -1;
+		}
+		else if (!child(S, Path, "items", rule.items))
+			return -1;
+
+		if (!child(S, Path, "additionalProperties", rule.additional) ||
+			!child(S, Path, "not", rule.notRule) ||
+			!list(S, Path, "allOf", rule.allFirst, rule.allCount) ||
+			!list(S, Path, "anyOf", rule.anyFirst, rule.anyCount) ||
+			!list(S, Path, "oneOf", rule.oneFirst, rule.oneCount))
+			return -1;
+
+		// $ref is applied along with the other keywords (as in 2019-09 
+		// and later) by adding it to allOf
+		n = S->find("$ref");
+
+		if (n)
+		{
+			std::vector< std::string > tokens;
+			cjson* target = NULL;
+
+			if (n->isStringCstr(text) && text[0] == '#' && pointerSplit(text + 1, tokens))
+				target = pointerFind(document, tokens, tokens.size());
+
+			if (!target)
+			{
+				fail(Path, "$ref", "not found (only local references are supported)");
+				return -1;
+			}
+
+			int ref = this->rule(target, text);
+
+			if (ref == -1)
+				return -1;
+
+			std::vector< int > all(program.lists.begin() + rule.allFirst, program.lists.begin() + rule.allFirst + rule.allCount);
+			all.push_back(ref);
+			rule.allFirst = (int)program.lists.size();
+			rule.allCount = (int)all.size();
+			program.lists.insert(program.lists.end(), all.begin(), all.end());
+		}
+
+		program.rules[index] = rule;
+
+		if (!properties(S, Path, index))
+			return -1;
+
+		return index;
+	}
+};
+
+cjson::Schema::Schema(Program* Compiled) :
+	program(Compiled)
+{
+}
+
+cjson::Schema::~Schema()
+{
+	delete program;
+}
+
+cjson::Schema* cjson::Schema::Compile(cjson* Document, std::string* Error)
+{
+	Program* program = new Program;
+	Compiler compiler(*program, Document);
+
+	program->root = compiler.rule(Document, "");
+
+	if (Error)
+		*Error = compiler.error;
+
+	if (program->root == -1)
+	{
+		delete program;
+		return NULL;
+	}
+
+	return new Schema(program);
+}
+
+bool cjson::Schema::validate(cjson* Node, std::string* Error)
+{
+	Check check(*program, false);
+
+	check.node(Node);
+
+	if (Error)
+		*Error = check.error();
+
+	return check.passed();
+}
+
+bool cjson::Schema::validate(const char* JSON, size_t Length, size_t* ErrorOffset, std::string* Error)
+{
+	Check check(*program);
+	Reader< Check > reader(check);
+
+	reader.scan(JSON, Length, false);
+
+	if (ErrorOffset)
+		*ErrorOffset = reader.errorOffset();
+
+	if (Error)
+		*Error = (reader.done() || !check.error().empty()) ? check.error() : "malformed JSON";
+
+	return reader.done() && check.passed();
+}
+
+struct cjson::Schema::Checked
+{
+	Builder builder;
+	Check check;
+
+	Checked(const Program& Compiled) :
+		check(Compiled)
+	{}
+
+	bool onStartObject() { return check.onStartObject() && builder.onStartObject(); }
+	bool onEndObject() { return check.onEndObject() && builder.onEndObject(); }
+	bool onStartArray() { return check.onStartArray() && builder.onStartArray(); }
+	bool onEndArray() { return check.onEndArray() && builder.onEndArray(); }
+	bool onKey(const char* Text, size_t Length) { return check.onKey(Text, Length) && builder.onKey(Text, Length); }
+	bool onString(const char* Text, size_t Length) { return check.onString(Text, Length) && builder.onString(Text, Length); }
+	bool onInt(int64_t Value) { return check.onInt(Value) && builder.onInt(Value); }
+	bool onDouble(double Value) { return check.onDouble(Value) && builder.onDouble(Value); }
+	bool onBool(bool Value) { return check.onBool(Value) && builder.onBool(Value); }
+	bool onNull() { return check.onNull() && builder.onNull(); }
+};
+
+bool cjson::Terminates(Schema::Checked* checked)
+{
+	return Terminates(&checked->builder);
+}
+
+cjson* cjson::Schema::parse(const char* JSON, size_t Length, size_t* ErrorOffset, std::string* Error)
+{
+	Checked checked(*program);
+	Reader< Checked > reader(checked);
+
+	reader.scan(JSON, Length, false);
+
+	if (ErrorOffset)
+		*ErrorOffset = reader.errorOffset();
+
+	if (Error)
+		*Error = (reader.done() || !checked.check.error().empty()) ? checked.check.error() : "malformed JSON";
+
+	if (!reader.done() || !checked.check.passed())
+	{
+		if (checked.builder.root)
+			cjson::DisposeDocument(checked.builder.root);
+		return NULL;
+	}
+
+	// top level value was not an array or object
+	if (!checked.builder.root)
+		return cjson::MakeDocument();
+
+	return checked.builder.root;
+}
+
+/*
+  Query - compiled path queries
+*/
+
+struct cjson::Query::Plan
+{
+	enum { NAME, ALL, FILTER };
+	enum { EXISTS, EQ, NE, LT, LE, GT, GE };
+
+	struct Step
+	{
+		int kind;
+		bool descend; // applied to the node and everything below it
+		std::string name;
+		int index; // name as an array index, or -1
+
+		// FILTER, field is the path from the member (empty for @)
+		std::vector< std::string > field;
+		int op;
+		cjsonType literal;
+		int64_t Int;
+		double Dbl;
+		bool Bool;
+		std::string Str;
+
+		Step() :
+			kind(NAME),
+			descend(false),
+			index(-1),
+			op(EXISTS),
+			literal(cjsonType::NUL),
+			Int(0),
+			Dbl(0),
+			Bool(false)
+		{}
+	};
+
+	std::vector< Step > steps;
+	std::string error;
+
+	bool fail(const char* Expression, const char* Cursor, const char* Problem)
+	{
+		error = std::string(Problem) + " at offset " + std::to_string(Cursor - Expression);
+		return false;
+	}
+
+	// read a name up to one of Stops, decoding ~0 and ~1
+	static void name(const char*& Cursor, const char* Stops, std::string& Name)
+	{
+		for (; *Cursor && !strchr(Stops, *Cursor); ++Cursor)
+		{
+			if (Cursor[0] == '~' && (Cursor[1] == '0' || Cursor[1] == '1'))
+				Name += (*++Cursor == '0') ? '~' : '/';
+			else
+				Name += *Cursor;
+		}
+	}
+
+	static void space(const char*& Cursor)
+	{
+		while (*Cursor == ' ' || *Cursor == '\t')
+			++Cursor;
+	}
+
+	bool filter(const char* Expression, const char*& Cursor, Step& step)
+	{
+		step.kind = FILTER;
+		Cursor += 2; // [?
+		space(Cursor);
+
+		// field, @ or a path from the member
+		if (*Cursor == '@')
+		{
+			++Cursor;
+
+			if (*Cursor == '/')
+				++Cursor;
+			else if (*Cursor && !strchr(" \t=!<>]", *Cursor))
+				return fail(Expression, Cursor, "expected / after @");
+		}
+
+		while (*Cursor && !strchr(" \t=!<>]", *Cursor))
+		{
+			std::string token;
+			name(Cursor, "/ \t=!<>]", token);
+
+			if (token.empty())
+				return fail(Expression, Cursor, "empty field name");
+
+			step.field.push_back(token);
+
+			if (*Cursor == '/')
+				++Cursor;
+		}
+
+		space(Cursor);
+
+		if (*Cursor == ']')
+		{
+			if (step.field.empty())
+				return fail(Expression, Cursor, "expected a field");
+
+			++Cursor;
+			return true;
+		}
+
+		static const char* const ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+		static const int opCodes[] = { EQ, NE, LE, GE, LT, GT };
+
+		step.op = EXISTS;
+
+		for (int i = 0; i < 6 && step.op == EXISTS; i++)
+		{
+			size_t length = strlen(ops[i]);
+
+			if (strncmp(Cursor, ops[i], length) == 0)
+			{
+				step.op = opCodes[i];
+				Cursor += length;
+			}
+		}
+
+		if (step.op == EXISTS)
+			return fail(Expression, Cursor, "expected an operator");
+
+		space(Cursor);
+
+		if (*Cursor == '"')
+		{
+			bool escaped;
+			const char* end = Cursor + strlen(Cursor);
+			const char* close = ScanQuote(Cursor + 1, end, escaped);
+
+			if (close == end || *close != '"')
+				return fail(Expression, Cursor, "unterminated string");
+
+			size_t length = close - (Cursor + 1);
+			step.Str.resize(length);
+
+			if (!Unescape(Cursor + 1, length, &step.Str[0], length))
+				return fail(Expression, Cursor, "bad escape sequence");
+
+			step.Str.resize(length);
+			step.literal = cjsonType::STR;
+			Cursor = close + 1;
+		}
+		else if (*Cursor == '\'')
+		{
+			const char* close = strchr(Cursor + 1, '\'');
+
+			if (!close)
+				return fail(Expression, Cursor, "unterminated string");
+
+			step.Str.assign(Cursor + 1, close - (Cursor + 1));
+			step.literal = cjsonType::STR;
+			Cursor = close + 1;
+		}
+		else if (strncmp(Cursor, "true", 4) == 0 || strncmp(Cursor, "false", 5) == 0)
+		{
+			step.Bool = (*Cursor == 't');
+			step.literal = cjsonType::BOOL;
+			Cursor += (step.Bool) ? 4 : 5;
+		}
+		else if (strncmp(Cursor, "null", 4) == 0)
+		{
+			step.literal = cjsonType::NUL;
+			Cursor += 4;
+		}
+		else
+		{
+			const char* start = Cursor;
+
+			while (*Cursor && strchr("+-.0123456789eE", *Cursor))
+				++Cursor;
+
+			switch ((Cursor > start) ? ParseNumber(start, Cursor, step.Int, step.Dbl) : 0)
+			{
+			case 1:
+				step.literal = cjsonType::INT;
+				break;
+			case 2:
+				step.literal = cjsonType::DBL;
+				break;
+			default:
+				return fail(Expression, start, "expected a literal");
+			}
+		}
+
+		space(Cursor);
+
+		if (*Cursor != ']')
+			return fail(Expression, Cursor, "expected ]");
+
+		++Cursor;
+		return true;
+	}
+
+	bool parse(const char* Expression)
+	{
+		const char* cursor = Expression;
+
+		while (*cursor)
+		{
+			Step step;
+
+			if (*cursor == '/')
+			{
+				++cursor;
+
+				if (*cursor == '/')
+				{
+					step.descend = true;
+					++cursor;
+				}
+			}
+			else if (cursor != Expression && *cursor != '[')
+				return fail(Expression, cursor, "expected /");
+
+			if (*cursor == '[')
+			{
+				if (cursor[1] != '?')
+					return fail(Expression, cursor, "expected [?");
+
+				if (!filter(Expression, cursor, step))
+					return false;
+			}
+			else if (*cursor == '*')
+			{
+				step.kind = ALL;
+				++cursor;
+			}
+			else
+			{
+				name(cursor, "/[", step.name);
+
+				if (step.name.empty())
+					return fail(Expression, cursor, "empty step");
+
+				step.index = pointerIndex(step.name);
+			}
+
+			steps.push_back(step);
+		}
+
+		return true;
+	}
+};
+
+struct cjson::Query::Run
+{
+	const Plan& plan;
+	Callback callback;
+	void* context;
+	cjson** results;
+	size_t capacity;
+	size_t count;
+
+	Run(const Plan& Compiled) :
+		plan(Compiled),
+		callback(NULL),
+		context(NULL),
+		results(NULL),
+		capacity(0),
+		count(0)
+	{}
+
+	// returns false to stop the query
+	bool emit(cjson* N)
+	{
+		if (results)
+		{
+			results[count++] = N;
+			return count < capacity;
+		}
+
+		++count;
+		return (callback) ? callback(context, N) : true;
+	}
+
+	static int compare(const Plan::Step& S, cjson* Field)
+	{
+		int64_t Int;
+		double Dbl;
+
+		if (S.literal == cjsonType::STR)
+			return strcmp(&Field->nodeData->asStr, S.Str.c_str());
+
+		if (Field->nodeType == cjsonType::INT && S.literal == cjsonType::INT)
+		{
+			Int = Field->nodeData->asInt;
+			return (Int < S.Int) ? -1 : (Int > S.Int) ? 1 : 0;
+		}
+
+		Dbl = (Field->nodeType == cjsonType::INT) ? (double)Field->nodeData->asInt : Field->nodeData->asDouble;
+		double literal = (S.literal == cjsonType::INT) ? (double)S.Int : S.Dbl;
+
+		return (Dbl < literal) ? -1 : (Dbl > literal) ? 1 : 0;
+	}
+
+	static bool passes(const Plan::Step& S, cjson* N)
+	{
+		for (size_t i = 0; N && i < S.field.size(); i++)
+		{
+			switch (N->nodeType)
+			{
+			case cjsonType::OBJECT:
+				N = N->find(S.field[i].c_str());
+				break;
+			case cjsonType::ARRAY:
+			{
+				int index = pointerIndex(S.field[i]);
+				N = (index < 0) ? NULL : N->at(index);
+			}
+			break;
+			default:
+				N = NULL;
+			}
+		}
+
+		if (S.op == Plan::EXISTS)
+			return (N != NULL);
+
+		bool numbers = 
+			(S.literal == cjsonType::INT || S.literal == cjsonType::DBL) &&
+			N && (N->nodeType == cjsonType::INT || N->nodeType == cjsonType::DBL);
+
+		// missing and mismatched fields are only not equal
+		if (!N || (!numbers && N->nodeType != S.literal) || 
+			(N->nodeType != cjsonType::NUL && !N->nodeData))
+			return (S.op == Plan::NE);
+
+		int order;
+
+		switch (S.literal)
+		{
+		case cjsonType::NUL:
+			order = 0;
+			break;
+		case cjsonType::BOOL:
+			order = (N->nodeData->asBool == S.Bool) ? 0 : 2; // unordered
+			break;
+		default:
+			order = compare(S, N);
+		}
+
+		switch (S.op)
+		{
+		case Plan::EQ:
+			return order == 0;
+		case Plan::NE:
+			return order != 0;
+		}
+
+		if (S.literal == cjsonType::NUL || S.literal == cjsonType::BOOL)
+			return false;
+
+		switch (S.op)
+		{
+		case Plan::LT:
+			return order < 0;
+		case Plan::LE:
+			return order <= 0;
+		case Plan::GT:
+			return order > 0;
+		default:
+			return order >= 0;
+		}
+	}
+
+	bool step(size_t Index, cjson* N)
+	{
+		if (Index == plan.steps.size())
+			return emit(N);
+
+		return (plan.steps[Index].descend) ? descend(Index, N) : select(Index, N);
+	}
+
+	// select at N, then at every container below it
+	bool descend(size_t Index, cjson* N)
+	{
+		if (!select(Index, N))
+			return false;
+
+		for (cjson* n = N->membersHead; n; n = n->siblingNext)
+			if (n->membersHead && !descend(Index, n))
+				return false;
+
+		return true;
+	}
+
+	// apply step Index to the members of N
+	bool select(size_t Index, cjson* N)
+	{
+		const Plan::Step& S = plan.steps[Index];
+
+		if (S.kind == Plan::NAME && N->nodeType == cjsonType::ARRAY)
+		{
+			cjson* item = (S.index < 0) ? NULL : N->at(S.index);
+			return (item) ? step(Index + 1, item) : true;
+		}
+
+		for (cjson* n = N->membersHead; n; n = n->siblingNext)
+		{
+			if (n->nodeType == cjsonType::VOIDED)
+				continue;
+
+			switch (S.kind)
+			{
+			case Plan::NAME:
+				if (!n->nodeName || strcmp(n->nodeName, S.name.c_str()) != 0)
+					continue;
+				break;
+			case Plan::FILTER:
+				if (!passes(S, n))
+					continue;
+				break;
+			}
+
+			if (!step(Index + 1, n))
+				return false;
+		}
+
+		return true;
+	}
+};
+
+cjson::Query::Query(Plan* Compiled) :
+	plan(Compiled)
+{
+}
+
+cjson::Query::~Query()
+{
+	delete plan;
+}
+
+cjson::Query* cjson::Query::Compile(const char* Expression, std::string* Error)
+{
+	Plan* plan = new Plan;
+	bool compiled = plan->parse(Expression);
+
+	if (Error)
+		*Error = plan->error;
+
+	if (!compiled)
+	{
+		delete plan;
+		return NULL;
+	}
+
+	return new Query(plan);
+}
+
+size_t cjson::Query::run(cjson* Node, Callback callback, void* Context)
+{
+	Run run(*plan);
+	run.callback = callback;
+	run.context = Context;
+
+	if (Node)
+		run.step(0, Node);
+
+	return run.count;
+}
+
+size_t cjson::Query::run(cjson* Node, cjson** Results, size_t Capacity)
+{
+	Run run(*plan);
+	run.results = Results;
+	run.capacity = Capacity;
+
+	if (Node && Capacity)
+		run.step(0, Node);
+
+	return run.count;
+}
+
+cjson* cjson::Query::first(cjson* Node)
+{
+	cjson* result = NULL;
+	run(Node, &result, 1);
+	return result;
+}
+
+/*
+  Columnar extraction
+*/
+
+// store Value in row Row of Col, returns false if it's the wrong type 
+// (or a DBL that doesn't fit an INT column)
+static bool columnStore(cjson::Column& Col, size_t Row, cjson* Value)
+{
+	int64_t Int;
+	double Dbl;
+	bool Bool;
+	char* Str;
+
+	switch (Col.type)
+	{
+	case cjsonType::INT:
+		if (Value->isDouble(Dbl) && Dbl == floor(Dbl) && Dbl >= -9.2e18 && Dbl <= 9.2e18)
+			Int = (int64_t)Dbl;
+		else if (!Value->isInt(Int))
+			return false;
+
+		Col.ints[Row] = Int;
+		return true;
+	case cjsonType::DBL:
+		if (Value->isInt(Int))
+			Dbl = (double)Int;
+		else if (!Value->isDouble(Dbl))
+			return false;
+
+		Col.doubles[Row] = Dbl;
+		return true;
+	case cjsonType::BOOL:
+		if (!Value->isBool(Bool))
+			return false;
+
+		Col.ints[Row] = (Bool) ? 1 : 0;
+		return true;
+	case cjsonType::STR:
+		if (!Value->isStringCstr(Str))
+			return false;
+
+		Col.text += Str;
+		return true;
+	default:
+		return false;
+	}
+}
+
+size_t cjson::ExtractColumns(cjson* Array, std::vector< Column >& Columns)
+{
+	size_t rows = (Array) ? Array->memberCount : 0;
+	std::vector< size_t > order(Columns.size());
+
+	for (size_t c = 0; c < Columns.size(); c++)
+	{
+		Column& col = Columns[c];
+
+		col.ints.assign((col.type == cjsonType::INT || col.type == cjsonType::BOOL) ? rows : 0, 0);
+		col.doubles.assign((col.type == cjsonType::DBL) ? rows : 0, 0);
+		col.offsets.assign((col.type == cjsonType::STR) ? rows : 0, 0);
+		col.text.clear();
+		col.valid.assign(rows, 0);
+
+		order[c] = c;
+	}
+
+	// columns are read in order of position so each record's members
+	// are walked once
+	bool moved = true;
+	size_t row = 0;
+
+	for (cjson* record = (Array) ? Array->membersHead.get() : NULL; record; record = record->siblingNext)
+	{
+		if (record->nodeType == cjsonType::VOIDED)
+			continue;
+
+		if (moved)
+		{
+			std::sort(order.begin(), order.end(), [&](size_t A, size_t B) { 
+				return Columns[A].position < Columns[B].position; 
+			});
+			moved = false;
+		}
+
+		cjson* member = (record->nodeType == cjsonType::OBJECT) ? record->membersHead.get() : NULL;
+		int position = 0;
+
+		for (size_t i = 0; i < order.size() && record->nodeType == cjsonType::OBJECT; i++)
+		{
+			Column& col = Columns[order[i]];
+
+			for (; member && position < col.position; position++)
+				member = member->siblingNext;
+
+			cjson* value = member;
+
+			if (!value || !value->nodeName || strcmp(value->nodeName, col.key) != 0)
+			{
+				// the key has moved (or this record doesn't have it)
+				value = NULL;
+				int at = 0;
+
+				for (cjson* n = record->membersHead; n; n = n->siblingNext, at++)
+				{
+					if (n->nodeName && strcmp(n->nodeName, col.key) == 0)
+					{
+						value = n;
+						col.position = at;
+						moved = true;
+						break;
+					}
+				}
+			}
+
+			if (col.type == cjsonType::STR)
+				col.offsets[row] = col.text.size();
+
+			if (value && columnStore(col, row, value))
+				col.valid[row] = 1;
+
+			if (col.type == cjsonType::STR)
+				col.text += '\0';
+		}
+
+		// records that aren't objects still need their empty strings
+		if (record->nodeType != cjsonType::OBJECT)
+		{
+			for (size_t c = 0; c < Columns.size(); c++)
+			{
+				if (Columns[c].type == cjsonType::STR)
+				{
+					Columns[c].offsets[row] = Columns[c].text.size();
+					Columns[c].text += '\0';
+				}
+			}
+		}
+
+		++row;
+	}
+
+	return row;
+}
+
+/*
+  Parallel traversal
+*/
+
+// arrays and objects with fewer members are formatted on one thread
+static const size_t parallelMinimum = 1024;
+
+// threads to use for Items items, Threads 0 is one per core
+unsigned parallelThreads(int Threads, size_t Items)
+{
+	unsigned threads = (Threads > 0) ? (unsigned)Threads : std::thread::hardware_concurrency();
+
+	if (!threads)
+		threads = 1;
+
+	return (Items < threads) ? std::max< unsigned >(1, (unsigned)Items) : threads;
+}
+
+// call work(first, last) for runs of Run items in [0, Count) on Threads
+// threads (this one included), threads take the next run as they finish
+template <typename Work>
+void parallelRuns(size_t Count, unsigned Threads, size_t Run, Work work)
+{
+	std::atomic< size_t > next(0);
+
+	auto worker = [&]() {
+		size_t first;
+
+		while ((first = next.fetch_add(Run)) < Count)
+			work(first, std::min(first + Run, Count));
+	};
+
+	std::vector< std::thread > pool;
+
+	for (unsigned t = 1; t < Threads; t++)
+		pool.push_back(std::thread(worker));
+
+	worker();
+
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+}
+
+void cjson::ParallelForEach(cjson* Node, EachCallback callback, void* Context, int Threads)
+{
+	if (!Node)
+		return;
+
+	std::vector< cjson* > members = Node->getNodes();
+	unsigned threads = parallelThreads(Threads, members.size());
+
+	if (members.empty())
+		return;
+
+	parallelRuns(members.size(), threads, std::max< size_t >(1, members.size() / (threads * 8)), 
+		[&](size_t First, size_t Last) {
+			for (size_t i = First; i < Last; i++)
+				callback(Context, members[i], i);
+		});
+}
+
+/*
+  Frozen documents
+*/
+
+cjson* cjson::FrozenIndex::find(const char* Name)
+{
+	if (!capacity)
+		return NULL;
+
+	uint32_t* slot = slots();
+	size_t mask = capacity - 1;
+
+	for (size_t i = hashText(0, Name) & mask; slot[i]; i = (i + 1) & mask)
+	{
+		cjson* n = members()[slot[i] - 1];
+		CJSON_COUNT(findCompares, 1);
+
+		if (strcmp(memberName(n), Name) == 0)
+			return n;
+	}
+
+	return NULL;
+}
+
+// the first of duplicate keys is kept, like find on the list
+void cjson::FrozenIndex::add(uint32_t Member)
+{
+	uint32_t* slot = slots();
+	size_t mask = capacity - 1;
+	const char* name = memberName(members()[Member]);
+	size_t i = hashText(0, name) & mask;
+
+	for (; slot[i]; i = (i + 1) & mask)
+		if (strcmp(memberName(members()[slot[i] - 1]), name) == 0)
+			return;
+
+	slot[i] = Member + 1;
+}
+
+cjson::FrozenIndex* cjson::frozenIndex()
+{
+	if (!(nodeFlags & FROZEN))
+		return NULL;
+
+	return (FrozenIndex*)nodeCache.get();
+}
+
+bool cjson::frozen()
+{
+	return (nodeFlags & FROZEN) != 0;
+}
+
+void cjson::Freeze_worker()
+{
+	if (nodeType == cjsonType::ARRAY || nodeType == cjsonType::OBJECT)
+	{
+		bool keys = (nodeType == cjsonType::OBJECT);
+
+		// at most half full so misses end quickly
+		int capacity = 0;
+
+		if (keys)
+			for (capacity = 1; capacity < memberCount * 2; capacity <<= 1);
+
+		FrozenIndex* index = (FrozenIndex*)mem->newPtr(sizeof(FrozenIndex) + 
+			memberCount * sizeof(cjson*) + capacity * sizeof(uint32_t));
+		index->count = memberCount;
+		index->capacity = capacity;
+
+		if (keys)
+			memset(index->slots(), 0, capacity * sizeof(uint32_t));
+
+		// Compact left no VOIDED nodes
+		int i = 0;
+
+		for (cjson* n = membersHead; n; n = n->siblingNext, i++)
+		{
+			index->members()[i] = n;
+			n->Freeze_worker();
+
+			if (keys)
+				index->add(i);
+		}
+
+		nodeCache = (char*)index;
+	}
+
+	nodeFlags |= FROZEN;
+}
+
+cjson* cjson::Freeze(cjson* Document)
+{
+	if (Document->readOnly())
+		return Document;
+
+	// nodes in the order they are read, with the indexes after them
+	Document = Compact(Document);
+
+	// hash memoizes as it goes, once frozen it only reads nodeHash
+	Document->hash();
+	Document->Freeze_worker();
+	return Document;
+}
+
+cjson::Published::Published(cjson* Document)
+{
+	if (Document)
+		publish(Document);
+}
+
+std::shared_ptr< cjson > cjson::Published::get() const
+{
+	return std::atomic_load(&current);
+}
+
+void cjson::Published::publish(cjson* Document)
+{
+	std::shared_ptr< cjson > next(Freeze(Document), cjson::DisposeDocument);
+	std::atomic_store(&current, next);
+}
+
+/*
+  Config cache
+*/
+
+// a file is read again when any of this changes
+struct fileIdentity
+{
+	uint64_t device;
+	uint64_t inode;
+	uint64_t size;
+	int64_t modified;
+
+	bool operator==(const fileIdentity& Other) const
+	{
+		return device == Other.device && inode == Other.inode && 
+			size == Other.size && modified == Other.modified;
+	}
+
+	bool operator!=(const fileIdentity& Other) const { return !(*this == Other); }
+};
+
+static bool getIdentity(const char* Path, fileIdentity& Identity)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(Path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	BY_HANDLE_FILE_INFORMATION info;
+	bool found = GetFileInformationByHandle(file, &info) != 0;
+	CloseHandle(file);
+
+	if (!found)
+		return false;
+
+	Identity.device = info.dwVolumeSerialNumber;
+	Identity.inode = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+	Identity.size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	Identity.modified = ((int64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat info;
+
+	if (stat(Path, &info) != 0)
+		return false;
+
+	Identity.device = (uint64_t)info.st_dev;
+	Identity.inode = (uint64_t)info.st_ino;
+	Identity.size = (uint64_t)info.st_size;
+
+	// nanoseconds, several writes can land in the same second
+#ifdef __APPLE__
+	Identity.modified = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	Identity.modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+
+	return true;
+}
+
+// read, parse and freeze Path, NULL with Error set if it can't be read
+// or isn't JSON
+static cjson* loadConfig(const char* Path, fileIdentity& Identity, std::string* Error)
+{
+	fileIdentity before;
+	FILE* file = (getIdentity(Path, before)) ? fopen(Path, "rb") : NULL;
+
+	if (!file)
+	{
+		if (Error)
+			*Error = std::string("can't read ") + Path;
+		return NULL;
+	}
+
+	std::string text;
+	text.reserve((size_t)before.size);
+
+	char buffer[65536];
+	size_t read;
+
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, read);
+
+	fclose(file);
+
+	// written to while it was read, try again later
+	if (!getIdentity(Path, Identity) || Identity != before)
+	{
+		if (Error)
+			*Error = std::string(Path) + " changed while it was read";
+		return NULL;
+	}
+
+	size_t offset;
+	cjson* document = cjson::Parse(text.c_str(), text.length(), &offset);
+
+	if (!document)
+	{
+		if (Error)
+			*Error = std::string(Path) + ": invalid JSON at offset " + std::to_string(offset);
+		return NULL;
+	}
+
+	return cjson::Freeze(document);
+}
+
+struct cjson::ConfigCache::Files
+{
+	struct Entry
+	{
+		fileIdentity identity;
+		std::shared_ptr< cjson > document;
+	};
+
+	std::mutex lock;
+	std::unordered_map< std::string, Entry > entries;
+
+	// background refresh
+	std::thread refresher;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+cjson::ConfigCache::ConfigCache(int Interval) :
+	files(new Files)
+{
+	files->stopping = false;
+
+	if (Interval > 0)
+	{
+		files->refresher = std::thread([this, Interval]() {
+			std::unique_lock< std::mutex > hold(files->lock);
+
+			while (!files->wake.wait_for(hold, std::chrono::milliseconds(Interval), [this]() { return files->stopping; }))
+			{
+				hold.unlock();
+				refresh();
+				hold.lock();
+			}
+		});
+	}
+}
+
+cjson::ConfigCache::~ConfigCache()
+{
+	{
+		std::lock_guard< std::mutex > hold(files->lock);
+		files->stopping = true;
+	}
+
+	files->wake.notify_all();
+
+	if (files->refresher.joinable())
+		files->refresher.join();
+
+	delete files;
+}
+
+std::shared_ptr< cjson > cjson::ConfigCache::get(const char* Path, std::string* Error)
+{
+	{
+		std::lock_guard< std::mutex > hold(files->lock);
+		auto found = files->entries.find(Path);
+
+		if (found != files->entries.end())
+			return found->second.document;
+	}
+
+	// first use, parsed without holding the lock
+	Files::Entry entry;
+	cjson* document = loadConfig(Path, entry.identity, Error);
+
+	if (!document)
+		return std::shared_ptr< cjson >();
+
+	entry.document = std::shared_ptr< cjson >(document, cjson::DisposeDocument);
+
+	// another thread may have loaded it first, theirs is kept
+	std::lock_guard< std::mutex > hold(files->lock);
+	return files->entries.emplace(Path, entry).first->second.document;
+}
+
+size_t cjson::ConfigCache::refresh()
+{
+	std::vector< std::pair< std::string, fileIdentity > > known;
+
+	{
+		std::lock_guard< std::mutex > hold(files->lock);
+
+		for (auto& entry : files->entries)
+			known.emplace_back(entry.first, entry.second.identity);
+	}
+
+	size_t reloaded = 0;
+
+	for (auto& file : known)
+	{
+		fileIdentity identity;
+
+		// a missing file keeps it's last version
+		if (!getIdentity(file.first.c_str(), identity) || identity == file.second)
+			continue;
+
+		cjson* document = loadConfig(file.first.c_str(), identity, NULL);
+
+		if (!document)
+			continue;
+
+		std::shared_ptr< cjson > replaced(document, cjson::DisposeDocument);
+
+		{
+			std::lock_guard< std::mutex > hold(files->lock);
+			Files::Entry& entry = files->entries[file.first];
+			entry.identity = identity;
+			entry.document.swap(replaced);
+		}
+
+		// the old version (if this was it's last handle) is disposed
+		// here, outside the lock
+		reloaded++;
+	}
+
+	return reloaded;
+}
+
+/*
+  Stats
+*/
+
+// names seen by Stats, an open addressed set of pointers
+struct statsNames
+{
+	std::vector< const char* > slots;
+	size_t used;
+
+	statsNames() : slots(1024), used(0) {}
+
+	// true the first time Name is seen
+	bool insert(const char* Name)
+	{
+		// at most half full
+		if (used * 2 >= slots.size())
+		{
+			std::vector< const char* > old(slots.size() * 2);
+			old.swap(slots);
+			used = 0;
+
+			for (const char* name : old)
+				if (name)
+					insert(name);
+		}
+
+		size_t mask = slots.size() - 1;
+
+		for (size_t i = hashMix((uint64_t)Name) & mask;; i = (i + 1) & mask)
+		{
+			if (slots[i] == Name)
+				return false;
+
+			if (!slots[i])
+			{
+				slots[i] = Name;
+				used++;
+				return true;
+			}
+		}
+	}
+};
+
+void cjson::Stats_worker(DocumentStats& Stats, void* Names, int Depth)
+{
+	Stats.nodes++;
+	Stats.types[(int)nodeType]++;
+	Stats.nodeBytes += sizeof(cjson);
+
+	if (nodeName && ((statsNames*)Names)->insert(nodeName))
+		Stats.nameBytes += strlen(nodeName) + 1;
+
+	if (nodeData)
+	{
+		switch (nodeType)
+		{
+		case cjsonType::INT:
+			Stats.scalarBytes += sizeof(int64_t);
+			break;
+		case cjsonType::DBL:
+			Stats.scalarBytes += sizeof(double);
+			break;
+		case cjsonType::BOOL:
+			Stats.scalarBytes += sizeof(bool);
+			break;
+		case cjsonType::STR:
+			Stats.stringBytes += strlen(&nodeData->asStr) + 1;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (nodeType == cjsonType::ARRAY || nodeType == cjsonType::OBJECT)
+	{
+		if (Depth + 1 > Stats.depth)
+			Stats.depth = Depth + 1;
+
+		size_t& widest = (nodeType == cjsonType::OBJECT) ? Stats.widestObject : Stats.longestArray;
+
+		if ((size_t)memberCount > widest)
+			widest = memberCount;
+
+		for (cjson* n = membersHead; n; n = n->siblingNext)
+			if (n->nodeType != cjsonType::VOIDED)
+				n->Stats_worker(Stats, Names, Depth + 1);
+	}
+}
+
+cjson::DocumentStats cjson::Stats(cjson* Node)
+{
+	DocumentStats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	statsNames names;
+	Node->Stats_worker(stats, &names, 0);
+
+	// only a root accounts for the whole HeapStack
+	if (Node->mem && !Node->rootNode)
+	{
+		size_t used = stats.nodeBytes + stats.nameBytes + stats.stringBytes + stats.scalarBytes;
+
+		stats.arenaBytes = (size_t)Node->mem->getBytes();
+		stats.unusedBytes = (stats.arenaBytes > used) ? stats.arenaBytes - used : 0;
+	}
+
+	return stats;
+}
+
+uint64_t cjson::KeyHash(const char* Text, size_t Length)
+{
+	return hashText(0, Text, Length);
+}
+
+// the members of Object are keys[First, end), names are only compared 
+// when their hashes match. Small objects are checked pairwise, larger 
+// ones through table, open addressed and at most half full, each slot 
+// holds the top of the hash and the place in keys (+ 1). A repeat moves
+// into the first member's place and takes it's entry in keys.
+void cjson::Builder::dedupe(cjson* Object, size_t First)
+{
+	size_t count = keys.size() - First;
+	size_t capacity = 0;
+	size_t mask = 0;
+
+	if (count > 8)
+	{
+		for (capacity = 16; capacity < count * 2; capacity <<= 1);
+		table.assign(capacity, 0);
+		mask = capacity - 1;
+	}
+
+	for (size_t i = First; i < keys.size(); i++)
+	{
+		uint64_t h = keys[i].first;
+		cjson* n = keys[i].second;
+		const char* name = memberName(n);
+		size_t match = 0;
+
+		if (capacity)
+		{
+			uint64_t tag = h & 0xFFFFFFFF00000000ULL;
+			size_t slot = h & mask;
+
+			for (; table[slot]; slot = (slot + 1) & mask)
+			{
+				size_t j = First + (table[slot] & 0xFFFFFFFF) - 1;
+
+				if ((table[slot] & 0xFFFFFFFF00000000ULL) == tag && keys[j].first == h &&
+					strcmp(memberName(keys[j].second), name) == 0)
+				{
+					match = j + 1;
+					break;
+				}
+			}
+
+			if (!match)
+			{
+				table[slot] = tag | (i - First + 1);
+				continue;
+			}
+		}
+		else
+		{
+			for (size_t j = First; j < i && !match; j++)
+				if (keys[j].first == h && keys[j].second && strcmp(memberName(keys[j].second), name) == 0)
+					match = j + 1;
+
+			if (!match)
+				continue;
+		}
+
+		cjson* first = keys[match - 1].second;
+
+		n->Unlink();
+		Object->LinkBefore(n, first);
+		first->Unlink();
+
+		keys[match - 1].second = n;
+		keys[i].second = NULL;
+	}
+}
+
+cjson* cjson::Parse( const char* JSON )
+{
+	return cjson::Parse( JSON, strlen(JSON) );
+}
+
+cjson* cjson::Parse( const char* JSON, size_t Length )
+{
+	CJSON_PHASE("parse", parseNanoseconds);
+
+	Builder builder;
+	builder.lenient = true;
+	Reader< Builder > reader( builder );
+
+	reader.scan( JSON, Length, false );
+
+	CJSON_COUNT(parseBytes, Length);
+	CJSON_COUNT(parseHeapBytes, (builder.root) ? builder.root->mem->getBytes() : 0);
+
+	// malformed documents return what was built up to the error
+	if (!builder.root)
+		return cjson::MakeDocument();
+
+	return builder.root;
+}
+
+cjson* cjson::Parse(std::string JSON)
+{
+	return cjson::Parse(JSON.c_str(), JSON.length());
+};
+
+bool cjson::Validate(const char* JSON, size_t Length, size_t* ErrorOffset, bool ValidateUTF8)
+{
+	Validator validator;
+	return cjson::ParseEvents(JSON, Length, validator, ErrorOffset, ValidateUTF8);
+}
+
+cjson* cjson::Parse(const char* JSON, size_t Length, size_t* ErrorOffset, bool ValidateUTF8)
+{
+	CJSON_PHASE("parse", parseNanoseconds);
+
+	Builder builder;
+	Reader< Builder > reader( builder, ValidateUTF8 );
+
+	reader.scan( JSON, Length, false );
+
+	CJSON_COUNT(parseBytes, Length);
+	CJSON_COUNT(parseHeapBytes, (builder.root) ? builder.root->mem->getBytes() : 0);
+
+	if (ErrorOffset)
+		*ErrorOffset = reader.errorOffset();
+
+	if (!reader.done())
+	{
+		if (builder.root)
+			cjson::DisposeDocument( builder.root );
+		return NULL;
+	}
+
+	// top level value was not an array or object
+	if (!builder.root)
+		return cjson::MakeDocument();
+
+	return builder.root;
+}
+
+// carryLength - helper for Parser::feed. carry holds the start of a token
+// that was split at the end of the last piece. Returns the number of bytes 
+// from JSON needed to complete the token including the byte that 
+// terminates it (or Length if the token continues past this piece too).
+size_t cjson::Parser::carryLength(const std::string& carry, const char* JSON, size_t Length)
+{
+	const char* end = JSON + Length;
+	const char* cursor = JSON;
+
+	if (carry[0] == '"')
+	{
+		// was the carry split in the middle of an escape?
+		bool escaped = false;
+
+		for (size_t i = 1; i < carry.length(); i++)
+		{
+			if (escaped)
+				escaped = false;
+			else if (carry[i] == '\\')
+				escaped = true;
+		}
+
+		if (escaped)
+			cursor++;
+
+		if (cursor >= end)
+			return Length;
+
+		bool escapes;
+		cursor = cjson::ScanQuote(cursor, end, escapes);
+	}
+	else
+	{
+		// numbers and true/false/null
+		while (cursor < end &&
+			((*cursor >= '0' && *cursor <= '9') ||
+			(*cursor >= 'a' && *cursor <= 'z') ||
+			(*cursor >= 'A' && *cursor <= 'Z') ||
+			*cursor == '-' || *cursor == '+' || *cursor == '.'))
+			cursor++;
+	}
+
+	if (cursor >= end)
+		return Length;
+
+	return (cursor - JSON) + 1;
+}
+
+cjson::Parser::Parser(bool ValidateUTF8) :
+	reader(builder, ValidateUTF8)
+{
+}
+
+cjson::Parser::~Parser()
+{
+	// document was never collected with finish
+	if (builder.root)
+		cjson::DisposeDocument(builder.root);
+}
+
+bool cjson::Parser::feed(const char* JSON, size_t Length)
+{
+	if (reader.failed())
+		return false;
+
+	// complete the token left over from the last piece, only the bytes
+	// belonging to that token are copied, the rest of this piece is 
+	// scanned in place.
+	if (carry.length())
+	{
+		size_t needed = carryLength(carry, JSON, Length);
+
+		carry.append(JSON, needed);
+
+		if (needed == Length)
+			return true; // still inside the token
+
+		size_t consumed = reader.scan(carry.data(), carry.length(), true);
+		size_t unused = carry.length() - consumed;
+
+		carry.clear();
+
+		if (reader.failed())
+			return false;
+
+		JSON += needed - unused;
+		Length -= needed - unused;
+	}
+
+	size_t consumed = reader.scan(JSON, Length, true);
+
+	if (reader.failed())
+		return false;
+
+	carry.assign(JSON + consumed, Length - consumed);
+	return true;
+}
+
+cjson* cjson::Parser::finish()
+{
+	if (carry.length() && !reader.failed())
+		reader.scan(carry.data(), carry.length(), false);
+
+	carry.clear();
+
+	cjson* result = builder.root;
+
+	if (!result)
+		result = cjson::MakeDocument();
+
+	builder.root = NULL;
+	builder.current = NULL;
+
+	return result;
+}
+
+bool cjson::Parser::failed()
+{
+	return reader.failed() || !reader.done();
+}
+
+size_t cjson::Parser::errorOffset()
+{
+	return reader.errorOffset();
+}
+
+// growable output for StringifyCstr
+struct CstrOutput
+{
+	char* buffer;
+	size_t length;
+	size_t capacity;
+};
+
+void CstrSink(void* Context, const char* Data, size_t Length)
+{
+	CstrOutput* out = (CstrOutput*)Context;
+
+	// leave room for the NULL terminator
+	if (out->length + Length + 1 > out->capacity)
+	{
+		size_t capacity = out->capacity * 2;
+
+		if (capacity < out->length + Length + 1)
+			capacity = out->length + Length + 1;
+
+		char* buffer = new char[capacity];
+		memcpy(buffer, out->buffer, out->length);
+		delete[] out->buffer;
+
+		out->buffer = buffer;
+		out->capacity = capacity;
+	}
+
+	memcpy(out->buffer + out->length, Data, Length);
+	out->length += Length;
+}
+
+// Stringify and StringifyCstr write a named node (other than a document
+// root) as a "name":value fragment, like the original Stringify did
+static void stringifyNode(cjson::Writer& writer, cjson* N)
+{
+	if (N->hasName() && strcmp(N->nameCstr(), "__root__") != 0)
+		writer.key(N->nameCstr());
+
+	writer.node(N);
+}
+
+char* cjson::StringifyCstr(cjson* N, const StringifyOptions& Options)
+{
+	CJSON_PHASE("stringify", stringifyNanoseconds);
+
+	CstrOutput out;
+	out.capacity = 4096;
+	out.buffer = new char[out.capacity];
+	out.length = 0;
+
+	{
+		Writer writer(CstrSink, &out, Options);
+		stringifyNode(writer, N);
+	} // writer flushes as it goes out of scope
+
+	out.buffer[out.length] = 0;
+	CJSON_COUNT(stringifyBytes, out.length);
+	return out.buffer;
+}
+
+std::string cjson::Stringify(cjson* N, const StringifyOptions& Options)
+{
+	CJSON_PHASE("stringify", stringifyNanoseconds);
+
+	std::string result;
+	Writer writer(result, Options);
+	stringifyNode(writer, N);
+	writer.flush();
+
+	CJSON_COUNT(stringifyBytes, result.length());
+	return result;
+}
+
+
+/*
+  Binary encoding - see ToBinary in cjson.h for the format
+*/
+
+enum binaryTag : unsigned char
+{
+	BIN_NULL = 0,
+	BIN_FALSE = 1,
+	BIN_TRUE = 2,
+	BIN_INT = 3,
+	BIN_DBL = 4,
+	BIN_STR = 5,
+	BIN_ARRAY = 6,
+	BIN_OBJECT = 7,
+	BIN_TINY = 0x40 // 0x40 to 0x7F are the integers 0 to 63
+};
+
+static const char binaryMagic[] = "CJB1";
+static const unsigned char binaryKeyDictionary = 1;
+
+typedef std::unordered_map< std::string, uint64_t > keyDictionary;
+
+__forceinline void writeVarint(std::string& out, uint64_t value)
+{
+	char bytes[10];
+	int count = 0;
+
+	while (value >= 0x80)
+	{
+		bytes[count++] = (char)(value | 0x80);
+		value >>= 7;
+	}
+
+	bytes[count++] = (char)value;
+	out.append(bytes, count);
+}
+
+__forceinline void writeText(std::string& out, const char* text)
+{
+	size_t length = strlen(text);
+	writeVarint(out, length);
+	out.append(text, length);
+}
+
+// count members that are not VOIDED
+int liveMembers(cjson* N)
+{
+	int count = 0;
+	cjson::curs c = N->cursor();
+
+	if (!c.down())
+		return 0;
+
+	do
+	{
+		if (c.current->type() != cjsonType::VOIDED)
+			count++;
+	} while (c.next());
+
+	return count;
+}
+
+void cjson::Binary_worker(std::string& out, void* Dictionary)
+{
+	keyDictionary* keys = (keyDictionary*)Dictionary;
+
+	switch (nodeType)
+	{
+	case cjsonType::NUL:
+		out.push_back(BIN_NULL);
+		break;
+	case cjsonType::BOOL:
+		out.push_back((nodeData->asBool) ? BIN_TRUE : BIN_FALSE);
+		break;
+	case cjsonType::INT:
+	{
+		int64_t value = (int64_t)nodeData->asInt;
+
+		if (value >= 0 && value < 64)
+		{
+			out.push_back((char)(BIN_TINY + value));
+		}
+		else
+		{
+			out.push_back(BIN_INT);
+			// zigzag so small negative numbers stay short
+			writeVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+		}
+	}
+	break;
+	case cjsonType::DBL:
+		out.push_back(BIN_DBL);
+		out.append((const char*)&nodeData->asDouble, sizeof(double));
+		break;
+	case cjsonType::STR:
+		out.push_back(BIN_STR);
+		writeText(out, &nodeData->asStr);
+		break;
+	case cjsonType::ARRAY:
+	case cjsonType::OBJECT:
+		out.push_back((nodeType == cjsonType::ARRAY) ? BIN_ARRAY : BIN_OBJECT);
+		writeVarint(out, liveMembers(this));
+
+		for (cjson* n = membersHead; n; n = n->siblingNext)
+		{
+			if (n->nodeType == cjsonType::VOIDED)
+				continue;
+
+			if (nodeType == cjsonType::OBJECT)
+			{
+				const char* name = memberName(n);
+
+				if (keys)
+					writeVarint(out, (*keys)[name]);
+				else
+					writeText(out, name);
+			}
+
+			n->Binary_worker(out, Dictionary);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// collect keys for the dictionary in first seen order
+void collectKeys(cjson* N, keyDictionary& keys, std::vector< const char* >& order)
+{
+	bool isObject = (N->type() == cjsonType::OBJECT);
+	cjson::curs c = N->cursor();
+
+	if (!c.down())
+		return;
+
+	do
+	{
+		cjson* n = c.current;
+
+		if (n->type() == cjsonType::VOIDED)
+			continue;
+
+		if (isObject)
+		{
+			const char* name = (n->nameCstr()) ? n->nameCstr() : "";
+
+			if (keys.emplace(name, order.size()).second)
+				order.push_back(name);
+		}
+
+		collectKeys(n, keys, order);
+	} while (c.next());
+}
+
+std::string cjson::ToBinary(cjson* N, bool KeyDictionary)
+{
+	std::string out;
+	keyDictionary keys;
+
+	out.append(binaryMagic, 4);
+	out.push_back((KeyDictionary) ? binaryKeyDictionary : 0);
+
+	if (KeyDictionary)
+	{
+		std::vector< const char* > order;
+		collectKeys(N, keys, order);
+
+		writeVarint(out, order.size());
+
+		for (size_t i = 0; i < order.size(); i++)
+			writeText(out, order[i]);
+	}
+
+	N->Binary_worker(out, (KeyDictionary) ? &keys : NULL);
+	return out;
+}
+
+// reads cjson binary, every read is bounds checked
+// FromBinary_worker recurses for each nested array or object, deeper 
+// data is rejected rather than risking the stack
+static const int binaryMaxDepth = 1024;
+
+struct cjson::BinaryDecoder
+{
+	const unsigned char* cursor;
+	const unsigned char* end;
+	std::vector< char* > keys; // dictionary keys already in the HeapStack
+	bool useKeys;
+	int depth; // FromBinary_worker recursion, see binaryMaxDepth
+
+	bool varint(uint64_t &value)
+	{
+		value = 0;
+
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (cursor >= end)
+				return false;
+
+			unsigned char byte = *cursor++;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+
+			if (!(byte & 0x80))
+				return true;
+		}
+
+		return false;
+	}
+
+	// read length prefixed text into the HeapStack
+	char* text(HeapStack* mem)
+	{
+		uint64_t length;
+
+		if (!varint(length) || length > (uint64_t)(end - cursor))
+			return NULL;
+
+		char* result = mem->newPtr(length + 1);
+		memcpy(result, cursor, length);
+		result[length] = 0;
+		cursor += length;
+		return result;
+	}
+};
+
+// read Count members into this (ARRAY or OBJECT) node
+bool cjson::FromBinary_worker(BinaryDecoder& decoder, cjsonType Type)
+{
+	uint64_t count;
+	uint64_t value;
+	uint64_t length;
+	cjson* node;
+
+	if (!decoder.varint(count))
+		return false;
+
+	for (uint64_t i = 0; i < count; i++)
+	{
+		char* name = NULL;
+
+		if (Type == cjsonType::OBJECT)
+		{
+			if (decoder.useKeys)
+			{
+				if (!decoder.varint(value) || value >= decoder.keys.size())
+					return false;
+				name = decoder.keys[(size_t)value];
+			}
+			else if (!(name = decoder.text(mem)))
+				return false;
+		}
+
+		if (decoder.cursor >= decoder.end)
+			return false;
+
+		unsigned char tag = *decoder.cursor++;
+
+		// scalars are allocated with their node in one block
+		switch (tag)
+		{
+		case BIN_NULL:
+			node = createNode();
+			node->nodeType = cjsonType::NUL;
+			break;
+		case BIN_FALSE:
+		case BIN_TRUE:
+			node = createValueNode(cjsonType::BOOL, sizeof(bool));
+			node->nodeData->asBool = (tag == BIN_TRUE);
+			break;
+		case BIN_INT:
+			if (!decoder.varint(value))
+				return false;
+			node = createValueNode(cjsonType::INT, sizeof(int64_t));
+			node->nodeData->asInt = (value >> 1) ^ (0 - (value & 1));
+			break;
+		case BIN_DBL:
+			if (decoder.end - decoder.cursor < (ptrdiff_t)sizeof(double))
+				return false;
+			node = createValueNode(cjsonType::DBL, sizeof(double));
+			memcpy(&node->nodeData->asDouble, decoder.cursor, sizeof(double));
+			decoder.cursor += sizeof(double);
+			break;
+		case BIN_STR:
+			if (!decoder.varint(length) || length > (uint64_t)(decoder.end - decoder.cursor))
+				return false;
+			node = createValueNode(cjsonType::STR, (size_t)length + 1);
+			memcpy(node->nodeData, decoder.cursor, (size_t)length);
+			(&node->nodeData->asStr)[length] = 0;
+			decoder.cursor += length;
+			break;
+		case BIN_ARRAY:
+		case BIN_OBJECT:
+			node = createNode();
+			node->nodeType = (tag == BIN_ARRAY) ? cjsonType::ARRAY : cjsonType::OBJECT;
+			node->nodeName = name;
+			Link(node);
+			if (++decoder.depth > binaryMaxDepth || 
+				!node->FromBinary_worker(decoder, node->nodeType))
+				return false;
+			decoder.depth--;
+			continue;
+		default:
+			if (tag < BIN_TINY || tag >= BIN_TINY + 64)
+				return false;
+			node = createValueNode(cjsonType::INT, sizeof(int64_t));
+			node->nodeData->asInt = tag - BIN_TINY;
+			break;
+		}
+
+		node->nodeName = name;
+		Link(node);
+	}
+
+	return true;
+}
+
+cjson* cjson::FromBinary(const char* Data, size_t Length)
+{
+	BinaryDecoder decoder;
+	decoder.cursor = (const unsigned char*)Data;
+	decoder.end = decoder.cursor + Length;
+	decoder.depth = 1;
+
+	if (Length < 6 || memcmp(Data, binaryMagic, 4) != 0)
+		return NULL;
+
+	decoder.cursor += 4;
+	decoder.useKeys = (*decoder.cursor++ & binaryKeyDictionary) != 0;
+
+	cjson* doc = cjson::MakeDocument();
+
+	if (decoder.useKeys)
+	{
+		uint64_t count;
+
+		if (!decoder.varint(count) || count > (uint64_t)(decoder.end - decoder.cursor))
+		{
+			cjson::DisposeDocument(doc);
+			return NULL;
+		}
+
+		decoder.keys.reserve((size_t)count);
+
+		for (uint64_t i = 0; i < count; i++)
+		{
+			char* key = decoder.text(doc->mem);
+
+			if (!key)
+			{
+				cjson::DisposeDocument(doc);
+				return NULL;
+			}
+
+			decoder.keys.push_back(key);
+		}
+	}
+
+	// the top level must be an array or object, like Parse
+	if (decoder.cursor >= decoder.end || 
+		(*decoder.cursor != BIN_ARRAY && *decoder.cursor != BIN_OBJECT))
+	{
+		cjson::DisposeDocument(doc);
+		return NULL;
+	}
+
+	if (*decoder.cursor++ == BIN_ARRAY)
+		doc->setType(cjsonType::ARRAY);
+
+	if (!doc->FromBinary_worker(decoder, doc->nodeType))
+	{
+		cjson::DisposeDocument(doc);
+		return NULL;
+	}
+
+	return doc;
+}
+
+/*
+  Packing
+*/
+
+// Packer is walked twice by Pack_worker, first with no buffer to 
+// measure the copy and then again to fill it in. With ShareNames each 
+// distinct name is stored once (smaller, but slower to pack). Nodes in 
+// the copy are given mem (NULL for snapshots).
+struct cjson::Packer
+{
+	char* buffer;
+	size_t used;
+	HeapStack* mem;
+	bool shareNames;
+	std::unordered_map< std::string, char* > names;
+
+	Packer(char* Buffer, size_t Start, HeapStack* Mem, bool ShareNames) :
+		buffer(Buffer),
+		used(Start),
+		mem(Mem),
+		shareNames(ShareNames)
+	{}
+
+	// everything is 8 byte aligned so nodes and values can be
+	// used in place
+	char* alloc(size_t Size)
+	{
+		char* ptr = (buffer) ? buffer + used : NULL;
+		used += (Size + 7) & ~(size_t)7;
+		return ptr;
+	}
+
+	char* name(const char* Name)
+	{
+		if (shareNames)
+		{
+			auto found = names.find(Name);
+
+			if (found != names.end())
+				return found->second;
+		}
+
+		size_t length = strlen(Name) + 1;
+		char* ptr = alloc(length);
+
+		if (ptr)
+			memcpy(ptr, Name, length);
+
+		if (shareNames)
+			names.emplace(Name, ptr);
+
+		return ptr;
+	}
+};
+
+cjson* cjson::Pack_worker(Packer& packer, cjson* Root)
+{
+	char* nodePtr = packer.alloc(sizeof(cjson));
+	cjson* node = (nodePtr) ? new (nodePtr) cjson(packer.mem, Root) : NULL;
+
+	char* namePtr = (nodeName) ? packer.name(nodeName) : NULL;
+	char* dataPtr = NULL;
+	size_t dataSize = 0;
+
+	if (nodeData)
+	{
+		switch (nodeType)
+		{
+		case cjsonType::INT:
+			dataSize = sizeof(int64_t);
+			break;
+		case cjsonType::DBL:
+			dataSize = sizeof(double);
+			break;
+		case cjsonType::BOOL:
+			dataSize = sizeof(bool);
+			break;
+		case cjsonType::STR:
+			dataSize = strlen(&nodeData->asStr) + 1;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (dataSize)
+	{
+		dataPtr = packer.alloc(dataSize);
+
+		if (dataPtr)
+			memcpy(dataPtr, nodeData, dataSize);
+	}
+
+	if (node)
+	{
+		node->nodeType = nodeType;
+		node->nodeName = namePtr;
+		node->nodeData = (dataUnion*)dataPtr;
+	}
+
+	// members follow their parent depth first, Link only touches
+	// node links so it works without a HeapStack
+	cjson* memberRoot = (Root) ? Root : node;
+
+	for (cjson* n = membersHead; n; n = n->siblingNext)
+	{
+		if (n->nodeType == cjsonType::VOIDED)
+			continue;
+
+		cjson* member = n->Pack_worker(packer, memberRoot);
+
+		if (node)
+			node->Link(member);
+	}
+
+	return node;
+}
+
+cjson* cjson::Compact(cjson* Document)
+{
+	Packer sizing(NULL, 0, NULL, true);
+	Document->Pack_worker(sizing, NULL);
+
+	HeapStack* mem = new HeapStack(2048);
+
+	// one allocation for the whole document
+	Packer packer(mem->newPtr(sizing.used), 0, mem, true);
+	cjson* newDoc = Document->Pack_worker(packer, NULL);
+
+	DisposeDocument(Document);
+	return newDoc;
+}
+
+cjson* cjson::Clone(cjson* Node, cjson* Target)
+{
+	if (Target->readOnly())
+		return NULL;
+
+	Packer sizing(NULL, 0, NULL, false);
+	Node->Pack_worker(sizing, NULL);
+
+	// one allocation for the whole copy
+	Packer packer(Target->mem->newPtr(sizing.used), 0, Target->mem, false);
+	return Node->Pack_worker(packer, Target->root());
+}
+
+/*
+  Snapshots
+*/
+
+static const char snapshotMagic[8] = { 'C', 'J', 'S', 'N', 'A', 'P', '1', 0 };
+static const uint32_t snapshotByteOrder = 0x01020304;
+
+// start of a snapshot image, the root node follows it
+struct snapshotHeader
+{
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t nodeSize; // sizeof(cjson) in the build that wrote it
+	uint64_t imageSize; // including this header
+	uint64_t reserved;
+};
+
+bool cjson::SaveSnapshot(cjson* Document, const char* Path)
+{
+	Packer sizing(NULL, sizeof(snapshotHeader), NULL, true);
+	Document->Pack_worker(sizing, NULL);
+
+	// zero filled, so padding in the image is always 0
+	std::vector< char > buffer(sizing.used);
+
+	Packer image(buffer.data(), sizeof(snapshotHeader), NULL, true);
+	Document->Pack_worker(image, NULL);
+
+	snapshotHeader* header = (snapshotHeader*)buffer.data();
+	memcpy(header->magic, snapshotMagic, sizeof(snapshotMagic));
+	header->byteOrder = snapshotByteOrder;
+	header->nodeSize = sizeof(cjson);
+	header->imageSize = buffer.size();
+
+	FILE* file = fopen(Path, "wb");
+
+	if (!file)
+		return false;
+
+	bool written = (fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size());
+
+	return (fclose(file) == 0 && written);
+}
+
+// Size bytes at Ptr are inside [Begin, End) and aligned like Pack_worker 
+// lays them out
+static bool snapshotRange(const void* Ptr, size_t Size, const char* Begin, const char* End, size_t Align)
+{
+	uintptr_t at = (uintptr_t)Ptr;
+
+	return at >= (uintptr_t)Begin && at <= (uintptr_t)End && 
+		Size <= (size_t)((uintptr_t)End - at) && at % Align == 0;
+}
+
+// a NUL terminated string inside [Begin, End)
+static bool snapshotText(const char* Text, const char* Begin, const char* End)
+{
+	return snapshotRange(Text, 1, Begin, End, 1) && memchr(Text, 0, End - Text) != NULL;
+}
+
+bool cjson::Snapshot_worker(cjson* Root, const char* Begin, const char* End)
+{
+	// every node as Pack_worker writes it, members are checked as a 
+	// list (links, parent and count) before any of them is visited
+	auto valid = [&](cjson* N) -> bool
+	{
+		if (N->mem || N->nodeFlags || N->nodeCache ||
+			N->rootNode != ((N == Root) ? NULL : Root) ||
+			N->nodeType < cjsonType::NUL || N->nodeType > cjsonType::BOOL)
+			return false;
+
+		if (N->nodeName && !snapshotText(N->nodeName, Begin, End))
+			return false;
+
+		char* data = (char*)N->nodeData.get();
+
+		switch (N->nodeType)
+		{
+		case cjsonType::INT:
+		case cjsonType::DBL:
+			if (data && !snapshotRange(data, 8, Begin, End, 8))
+				return false;
+			break;
+		case cjsonType::BOOL:
+			if (data && !snapshotRange(data, sizeof(bool), Begin, End, 8))
+				return false;
+			break;
+		case cjsonType::STR:
+			if (data && !(snapshotRange(data, 1, Begin, End, 8) && snapshotText(data, Begin, End)))
+				return false;
+			break;
+		default:
+			if (data)
+				return false;
+		}
+
+		// replacing a container with a value keeps it's members (they
+		// are saved but not used), so any node can have a list
+		int count = 0;
+		cjson* prev = NULL;
+
+		for (cjson* n = N->membersHead; n; n = n->siblingNext)
+		{
+			if (!snapshotRange(n, sizeof(cjson), Begin, End, 8) || 
+				n->siblingPrev != prev || n->parentNode != N || ++count > N->memberCount)
+				return false;
+
+			prev = n;
+		}
+
+		return N->membersTail == prev && count == N->memberCount;
+	};
+
+	if (Root->parentNode || Root->siblingPrev || Root->siblingNext || !valid(Root))
+		return false;
+
+	// depth first using the links just checked, so deep documents 
+	// don't use stack
+	cjson* n = Root;
+
+	while (true)
+	{
+		if (n->membersHead)
+		{
+			n = n->membersHead;
+		}
+		else
+		{
+			while (n != Root && !n->siblingNext)
+				n = n->parentNode;
+
+			if (n == Root)
+				return true;
+
+			n = n->siblingNext;
+		}
+
+		if (!valid(n))
+			return false;
+	}
+}
+
+void unmapSnapshot(char* Base, size_t Size)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(Base);
+#else
+	munmap(Base, Size);
+#endif
+}
+
+cjson* cjson::LoadSnapshot(const char* Path, bool Trusted)
+{
+	size_t size;
+	char* base;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(file, &fileSize) || 
+		fileSize.QuadPart < (LONGLONG)(sizeof(snapshotHeader) + sizeof(cjson)))
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+
+	// the view keeps the file and mapping open once it's created
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if (!mapping)
+		return NULL;
+
+	base = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if (!base)
+		return NULL;
+#else
+	int file = open(Path, O_RDONLY);
+
+	if (file == -1)
+		return NULL;
+
+	struct stat info;
+
+	if (fstat(file, &info) != 0 || 
+		info.st_size < (off_t)(sizeof(snapshotHeader) + sizeof(cjson)))
+	{
+		close(file);
+		return NULL;
+	}
+
+	size = (size_t)info.st_size;
+
+	// the mapping keeps the file open once it's created
+	void* mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+
+	if (mapped == MAP_FAILED)
+		return NULL;
+
+	base = (char*)mapped;
+#endif
+
+	snapshotHeader* header = (snapshotHeader*)base;
+
+	if (memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0 ||
+		header->byteOrder != snapshotByteOrder ||
+		header->nodeSize != sizeof(cjson) ||
+		header->imageSize != size ||
+		(!Trusted && !Snapshot_worker((cjson*)(base + sizeof(snapshotHeader)), base + sizeof(snapshotHeader), base + size)))
+	{
+		unmapSnapshot(base, size);
+		return NULL;
+	}
+
+	return (cjson*)(base + sizeof(snapshotHeader));
+}
+
+void cjson::DisposeDocument( cjson* Document )
+{
+	// mapped snapshot, the header is just before the root node
+	if (!Document->mem)
+	{
+		snapshotHeader* header = (snapshotHeader*)((char*)Document - sizeof(snapshotHeader));
+		unmapSnapshot((char*)header, (size_t)header->imageSize);
+		return;
+	}
+
+	delete Document->mem;
+};
+
+cjson* cjson::MakeDocument()
+{
+	HeapStack* mem = new HeapStack( 2048 );
+	void* Data = mem->newPtr(sizeof(cjson));
+	CJSON_COUNT(documents, 1);
+
+	// we are going to allocate this node using "palcement new"
+	// in the HeapStack
+	cjson* newNode = new (Data) cjson(mem, NULL);
+
+	newNode->setName("__root__");
+	newNode->setType(cjsonType::OBJECT);
+
+	return newNode;
+};
+
+cjson* cjson::GetNodeByPath(std::string Path)
+{
+
+	cjson* N = this;
+
+	std::vector<std::string> parts;
+	Split(Path, '/', parts);
+
+	for (int i = 0; i < parts.size(); i++)
+	{
+
+		switch (N->nodeType)
+		{
+		case cjsonType::OBJECT:
+		{
+			cjson* Next = N->find(parts[i]);
+
+			if (!Next)
+				return NULL;
+
+			N = Next;
+
+		}
+		break;
+		case cjsonType::ARRAY:
+		{
+			int Index = atoi(parts[i].c_str());
+
+			if (Index < 0 || Index >= N->size())
+				return NULL;
+
+			N = N->at(Index);
+
+			if (!N)
+				return NULL;
+
+		}
+		break;
+		}
+
+	}
+
+	return N;
+
+}
+
+// internal add member
+void cjson::Link(cjson* newNode)
+{
+
+	newNode->parentNode = this;
+	changed();
+
+	// members are basically children directly owned
+	// by the current node. They are stored as a linked
+	// list maintained by the parent node.
+	// nodes can also see their siblings via siblingPrev and
+	// siblingNext
+
+	if (!membersHead)
+	{
+		membersHead = newNode;
+		membersTail = newNode;
+		newNode->siblingNext = NULL;
+		newNode->siblingPrev = NULL;
+	}
+	else
+	{
+		cjson* lastTail = membersTail;
+		// set the current tails sibling to the node		
+		membersTail->siblingNext = newNode;
+		// new nodes previous is the last tail
+		newNode->siblingPrev = lastTail;
+		newNode->siblingNext = NULL;
+		// set the current tail to the node;
+		membersTail = newNode;
+	}
+
+	memberCount++;
+
+};
+
+// internal insert member
+void cjson::LinkBefore(cjson* newNode, cjson* Before)
+{
+	if (!Before)
+	{
+		Link(newNode);
+		return;
+	}
+
+	newNode->parentNode = this;
+	changed();
+
+	newNode->siblingNext = Before;
+	newNode->siblingPrev = Before->siblingPrev;
+
+	if (Before->siblingPrev)
+		Before->siblingPrev->siblingNext = newNode;
+	else
+		membersHead = newNode;
+
+	Before->siblingPrev = newNode;
+
+	memberCount++;
+};
+
+// internal remove member
+void cjson::Unlink()
+{
+	cjson* parent = parentNode;
+
+	if (!parent)
+		return;
+
+	parent->changed();
+
+	if (siblingPrev)
+		siblingPrev->siblingNext = siblingNext;
+	else
+		parent->membersHead = siblingNext;
+
+	if (siblingNext)
+		siblingNext->siblingPrev = siblingPrev;
+	else
+		parent->membersTail = siblingPrev;
+
+	parent->memberCount--;
+
+	// siblingPrev and siblingNext are left as they were, so a loop that
+	// removes the node it's on can still step to the next one. Link and
+	// LinkBefore set both.
+	parentNode = NULL;
+};
+
+// helper for Stringify_worder
+__forceinline void emitText(char* &writer, const char* text)
+{
+	while (*text)
+	{
+		*writer = *text;
+		++writer;
+		++text;
+	}
+}
+
+// helper for Stringify_worder
+__forceinline void emitText(char* &writer, const char text)
+{
+	*writer = text;
+	++writer;
+}
+
+// longest text emitInt or emitDouble can produce ("%0.7f" of DBL_MAX 
+// is 317 characters)
+const size_t maxNumberText = 330;
+
+// helper for Stringify_worker and Writer, formats integers
+// without the overhead of sprintf
+__forceinline void emitInt(char* &writer, int64_t value)
+{
+	char digits[20];
+	int count = 0;
+	uint64_t magnitude = (uint64_t)value;
+
+	if (value < 0)
+	{
+		emitText(writer, '-');
+		magnitude = 0 - magnitude;
+	}
+
+	do
+	{
+		digits[count++] = '0' + (char)(magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	while (count)
+		emitText(writer, digits[--count]);
+}
+
+// helper for Stringify_worker and Writer, formats doubles
+__forceinline void emitDouble(char* &writer, double value)
+{
+	if (value == 0)
+	{
+		emitText(writer, "0.0");
+	}
+	else
+	{
+		//doc.setf(std::ios_base::fixed, std::ios::floatfield);
+		//doc << std::setprecision(9) << N->nodeData->asDouble;
+		//emitText(writer, std::to_string(N->nodeData->asDouble).c_str());
+		writer += sprintf(writer, "%0.7f", value);
+	}
+}
+
+
+/*
+  Member functions for cjson::Writer
+*/
+
+cjson::Writer::Writer(std::string& Output, const StringifyOptions& Options) :
+	output(&Output),
+	sink(NULL),
+	context(NULL),
+	options(Options),
+	comma(false),
+	afterKey(false),
+	depth(0),
+	writer(buffer),
+	recordDepth(0),
+	recordFrom(buffer)
+{
+}
+
+cjson::Writer::Writer(Sink Output, void* Context, const StringifyOptions& Options) :
+	output(NULL),
+	sink(Output),
+	context(Context),
+	options(Options),
+	comma(false),
+	afterKey(false),
+	depth(0),
+	writer(buffer),
+	recordDepth(0),
+	recordFrom(buffer)
+{
+}
+
+cjson::Writer::~Writer()
+{
+	flush();
+}
+
+void cjson::Writer::flush()
+{
+	size_t length = writer - buffer;
+
+	if (!length)
+		return;
+
+	if (recordDepth)
+		syncRecord();
+
+	if (output)
+		output->append(buffer, length);
+	else if (sink)
+		sink(context, buffer, length);
+
+	writer = buffer;
+	recordFrom = buffer;
+}
+
+// start capturing output, returns the offset in record where 
+// this recording starts
+size_t cjson::Writer::beginRecord()
+{
+	if (!recordDepth++)
+	{
+		record.clear();
+		spans.clear();
+		recordFrom = writer;
+	}
+	else
+	{
+		syncRecord();
+	}
+
+	return record.size();
+}
+
+// move captured output that is still in the buffer into record
+void cjson::Writer::syncRecord()
+{
+	record.append(recordFrom, writer - recordFrom);
+	recordFrom = writer;
+}
+
+void cjson::Writer::endRecord()
+{
+	--recordDepth;
+}
+
+bool cjson::Writer::caching()
+{
+	return (options.cache && !options.indent && !options.sortKeys);
+}
+
+// make sure Length bytes can be written to the buffer
+__forceinline void cjson::Writer::reserve(size_t Length)
+{
+	if ((size_t)(buffer + sizeof(buffer) - writer) < Length)
+		flush();
+}
+
+// whitespace for pretty printing, indentation is copied from here
+// in blocks rather than built up a character at a time
+static const char indentSpaces[] = 
+	"                                                                "
+	"                                                                ";
+
+// start a new line indented for the current depth
+void cjson::Writer::newLine()
+{
+	size_t spaces = (size_t)depth * options.indent;
+
+	// usual case, the line break and indent are copied with one reserve
+	if (spaces < sizeof(indentSpaces))
+		reserve(spaces + 2);
+	else
+		reserve(2);
+
+	if (options.crlf)
+		emitText(writer, '\r');
+	emitText(writer, '\n');
+
+	if (spaces < sizeof(indentSpaces))
+	{
+		memcpy(writer, indentSpaces, spaces);
+		writer += spaces;
+		return;
+	}
+
+	while (spaces)
+	{
+		size_t count = (spaces < sizeof(indentSpaces) - 1) ? spaces : sizeof(indentSpaces) - 1;
+		text(indentSpaces, count);
+		spaces -= count;
+	}
+}
+
+// emit a comma if this is not the first value at this level, when
+// pretty printing each member starts on a new line. A value following
+// a key gets neither.
+__forceinline void cjson::Writer::separator()
+{
+	if (afterKey)
+	{
+		afterKey = false;
+		return;
+	}
+
+	if (comma)
+	{
+		reserve(1);
+		emitText(writer, ',');
+	}
+
+	if (options.indent && depth)
+		newLine();
+}
+
+// copy text into the buffer, flushing as often as needed
+void cjson::Writer::text(const char* Text, size_t Length)
+{
+	while (Length)
+	{
+		size_t space = buffer + sizeof(buffer) - writer;
+
+		if (!space)
+		{
+			flush();
+			continue;
+		}
+
+		size_t count = (Length < space) ? Length : space;
+		memcpy(writer, Text, count);
+		writer += count;
+		Text += count;
+		Length -= count;
+	}
+}
+
+void cjson::Writer::beginObject()
+{
+	separator();
+	reserve(1);
+	emitText(writer, '{');
+	comma = false;
+	++depth;
+}
+
+void cjson::Writer::endObject()
+{
+	--depth;
+
+	// comma is set if the object has members
+	if (options.indent && comma)
+		newLine();
+
+	reserve(1);
+	emitText(writer, '}');
+	comma = true;
+}
+
+void cjson::Writer::beginArray()
+{
+	separator();
+	reserve(1);
+	emitText(writer, '[');
+	comma = false;
+	++depth;
+}
+
+void cjson::Writer::endArray()
+{
+	--depth;
+
+	if (options.indent && comma)
+		newLine();
+
+	reserve(1);
+	emitText(writer, ']');
+	comma = true;
+}
+
+// ScanClean - helper for Writer::escaped, returns the position of the
+// first character that must be escaped (or end). Tests 16 bytes at a
+// time with SSE2.
+__forceinline const char* ScanClean(const char* cursor, const char* end)
+{
+#ifdef CJSON_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i slash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+
+	while (end - cursor >= 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)cursor);
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(
+			_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, slash)),
+				_mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control)));
+
+		if (mask)
+			return cursor + FirstBit(mask);
+
+		cursor += 16;
+	}
+#endif
+
+	while (cursor < end &&
+		*cursor != '"' &&
+		*cursor != '\\' &&
+		(unsigned char)*cursor >= 0x20)
+		cursor++;
+
+	return cursor;
+}
+
+// write Text as the inside of a JSON string. Clean runs are copied as
+// a block, only the characters that need it are escaped.
+void cjson::Writer::escaped(const char* Text, size_t Length)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char* end = Text + Length;
+
+	while (Text < end)
+	{
+		const char* clean = Text;
+		Text = ScanClean(Text, end);
+		text(clean, Text - clean);
+
+		if (Text == end)
+			break;
+
+		reserve(6);
+		emitText(writer, '\\');
+
+		switch (*Text)
+		{
+		case '"':
+			emitText(writer, '"');
+			break;
+		case '\\':
+			emitText(writer, '\\');
+			break;
+		case '\b':
+			emitText(writer, 'b');
+			break;
+		case '\f':
+			emitText(writer, 'f');
+			break;
+		case '\n':
+			emitText(writer, 'n');
+			break;
+		case '\r':
+			emitText(writer, 'r');
+			break;
+		case '\t':
+			emitText(writer, 't');
+			break;
+		default:
+			emitText(writer, "u00");
+			emitText(writer, hex[(unsigned char)*Text >> 4]);
+			emitText(writer, hex[*Text & 0xF]);
+			break;
+		}
+
+		++Text;
+	}
+}
+
+void cjson::Writer::key(const char* Key, size_t Length)
+{
+	separator();
+	reserve(1);
+	emitText(writer, '"');
+	escaped(Key, Length);
+	reserve(3);
+	emitText(writer, (options.indent) ? "\": " : "\":");
+	afterKey = true;
+}
+
+void cjson::Writer::key(const char* Key)
+{
+	key(Key, strlen(Key));
+}
+
+void cjson::Writer::key(const std::string& Key)
+{
+	key(Key.c_str(), Key.length());
+}
+
+void cjson::Writer::value(int64_t Value)
+{
+	separator();
+	reserve(maxNumberText);
+	emitInt(writer, Value);
+	comma = true;
+}
+
+void cjson::Writer::value(int Value)
+{
+	value((int64_t)Value);
+}
+
+void cjson::Writer::value(double Value)
+{
+	separator();
+	reserve(maxNumberText);
+	emitDouble(writer, Value);
+	comma = true;
+}
+
+void cjson::Writer::value(bool Value)
+{
+	separator();
+	reserve(5);
+	emitText(writer, (Value) ? "true" : "false");
+	comma = true;
+}
+
+void cjson::Writer::value(const char* Value, size_t Length)
+{
+	separator();
+	reserve(1);
+	emitText(writer, '"');
+	escaped(Value, Length);
+	reserve(1);
+	emitText(writer, '"');
+	comma = true;
+}
+
+void cjson::Writer::value(const char* Value)
+{
+	value(Value, strlen(Value));
+}
+
+void cjson::Writer::value(const std::string& Value)
+{
+	value(Value.c_str(), Value.length());
+}
+
+void cjson::Writer::null()
+{
+	separator();
+	reserve(4);
+	emitText(writer, "null");
+	comma = true;
+}
+
+void cjson::Writer::node(cjson* N)
+{
+	cjson::Stringify_worker(N, *this);
+}
+
+// used to sort members when StringifyOptions::sortKeys is set
+bool CompareNames(cjson* A, cjson* B)
+{
+	const char* a = A->nameCstr();
+	const char* b = B->nameCstr();
+	return strcmp(a ? a : "", b ? b : "") < 0;
+}
+
+void cjson::Stringify_worker(cjson* N, Writer& writer)
+{
+	CJSON_COUNT(stringifyNodes, 1);
+
+	switch (N->nodeType)
+	{
+	case cjsonType::NUL:
+		writer.null();
+		break;
+	case cjsonType::INT:
+		writer.value((int64_t)N->nodeData->asInt);
+		break;
+	case cjsonType::DBL:
+		writer.value(N->nodeData->asDouble);
+		break;
+	case cjsonType::STR:
+		writer.value(&N->nodeData->asStr);
+		break;
+	case cjsonType::BOOL:
+		writer.value(N->nodeData->asBool);
+		break;
+	case cjsonType::ARRAY:
+	case cjsonType::OBJECT:
+		if (writer.caching() && !N->readOnly())
+			Stringify_cached(N, writer);
+		else
+			Stringify_members(N, writer);
+		break;
+	default:
+		break;
+	}
+}
+
+// write an ARRAY or OBJECT node
+void cjson::Stringify_members(cjson* N, Writer& writer)
+{
+	if (writer.options.threads != 1 && !writer.caching() && (size_t)N->memberCount >= parallelMinimum)
+	{
+		std::vector< cjson* > members = N->getNodes();
+
+		if (N->nodeType == cjsonType::OBJECT && writer.options.sortKeys)
+			std::stable_sort(members.begin(), members.end(), CompareNames);
+
+		Stringify_parallel(N, members, writer);
+		return;
+	}
+
+	if (N->nodeType == cjsonType::ARRAY)
+	{
+		writer.beginArray();
+
+		for (cjson* n = N->membersHead; n; n = n->siblingNext)
+		{
+			if (n->nodeType != cjsonType::VOIDED)
+				Stringify_worker(n, writer);
+		}
+
+		writer.endArray();
+		return;
+	}
+
+	writer.beginObject();
+
+	if (writer.options.sortKeys)
+	{
+		std::vector< cjson* > members = N->getNodes();
+		std::stable_sort(members.begin(), members.end(), CompareNames);
+
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			writer.key(memberName(members[i]));
+			Stringify_worker(members[i], writer);
+		}
+	}
+	else
+	{
+		for (cjson* n = N->membersHead; n; n = n->siblingNext)
+		{
+			if (n->nodeType == cjsonType::VOIDED)
+				continue;
+
+			writer.key(memberName(n));
+			Stringify_worker(n, writer);
+		}
+	}
+
+	writer.endObject();
+}
+
+// write an ARRAY or OBJECT node on several threads (StringifyOptions::threads),
+// Members are formatted in runs, each into it's own buffer, then the 
+// buffers are written in order
+void cjson::Stringify_parallel(cjson* N, std::vector< cjson* >& Members, Writer& writer)
+{
+	bool object = (N->nodeType == cjsonType::OBJECT);
+	unsigned threads = parallelThreads(writer.options.threads, Members.size());
+	size_t run = std::max< size_t >(1, (Members.size() + (threads * 8) - 1) / (threads * 8));
+	std::vector< std::string > parts((Members.size() + run - 1) / run);
+
+	StringifyOptions options = writer.options;
+	options.threads = 1;
+
+	if (object)
+		writer.beginObject();
+	else
+		writer.beginArray();
+
+	int depth = writer.depth;
+
+	parallelRuns(Members.size(), threads, run, [&](size_t First, size_t Last) {
+		Writer part(parts[First / run], options);
+		part.depth = depth;
+		part.comma = (First != 0);
+
+		for (size_t i = First; i < Last; i++)
+		{
+			if (object)
+				part.key(memberName(Members[i]));
+			Stringify_worker(Members[i], part);
+		}
+	});
+
+	for (size_t i = 0; i < parts.size(); i++)
+		writer.text(parts[i].data(), parts[i].length());
+
+	writer.comma = !Members.empty();
+
+	if (object)
+		writer.endObject();
+	else
+		writer.endArray();
+}
+
+// nodeCache starts with this, then links cacheLinks and length bytes
+// of JSON. The output of each linked member goes at it's place in the 
+// text, so a node doesn't hold another copy of it's members' caches.
+struct cacheHeader
+{
+	uint32_t length;
+	uint32_t capacity; // bytes for links and text
+	uint32_t links;
+	uint32_t unused;
+};
+
+struct cacheLink
+{
+	size_t at;
+	cjson* node;
+};
+
+// smaller subtrees are cheaper to format again than to cache
+static const size_t cacheMinimum = 64;
+
+// write the cached output of N (which is CACHE_VALID), members that 
+// changed have cleared N's flags as well, so linked members are valid
+void cjson::Stringify_copy(cjson* N, Writer& writer)
+{
+	cacheHeader* header = (cacheHeader*)N->nodeCache.get();
+	cacheLink* links = (cacheLink*)(header + 1);
+	const char* text = (const char*)(links + header->links);
+	size_t at = 0;
+
+	for (uint32_t i = 0; i < header->links; i++)
+	{
+		writer.text(text + at, links[i].at - at);
+		Stringify_copy(links[i].node, writer);
+		at = links[i].at;
+	}
+
+	writer.text(text + at, header->length - at);
+}
+
+// write an ARRAY or OBJECT node using nodeCache (StringifyOptions::cache)
+//
+// Nodes are only cached once they have been written twice without 
+// changing in between, so nodes on frequently changed paths (like the 
+// root) are not copied into the cache over and over. Cache space is 
+// reused when the new output fits.
+void cjson::Stringify_cached(cjson* N, Writer& writer)
+{
+	if (N->nodeFlags & CACHE_VALID)
+	{
+		writer.separator();
+
+		size_t start = 0;
+
+		if (writer.recordDepth)
+		{
+			writer.syncRecord();
+			start = writer.record.size();
+		}
+
+		Stringify_copy(N, writer);
+		writer.comma = true;
+
+		// a recording parent links to this rather than copying it
+		if (writer.recordDepth)
+		{
+			writer.syncRecord();
+			Writer::cacheSpan span = { start, writer.record.size(), N };
+			writer.spans.push_back(span);
+		}
+
+		return;
+	}
+
+	// changed since the last Stringify (or never written)
+	if (!(N->nodeFlags & CACHE_CLEAN))
+	{
+		N->nodeFlags |= CACHE_CLEAN;
+		Stringify_members(N, writer);
+		return;
+	}
+
+	// the separator isn't part of the cached output, afterKey 
+	// stops beginArray/beginObject writing it again
+	writer.separator();
+	writer.afterKey = true;
+
+	size_t start = writer.beginRecord();
+	size_t firstSpan = writer.spans.size();
+	Stringify_members(N, writer);
+	writer.syncRecord();
+
+	size_t length = writer.record.size() - start;
+
+	if (length >= cacheMinimum && length <= UINT32_MAX)
+	{
+		// cached members written since start are linked, not copied
+		size_t linkCount = writer.spans.size() - firstSpan;
+		size_t textLength = length;
+
+		for (size_t i = firstSpan; i < writer.spans.size(); i++)
+			textLength -= writer.spans[i].end - writer.spans[i].start;
+
+		size_t needed = linkCount * sizeof(cacheLink) + textLength;
+		cacheHeader* header = (cacheHeader*)N->nodeCache.get();
+
+		if (!header || header->capacity < needed)
+		{
+			// half as much again, so small edits reuse the space and a 
+			// growing node leaves little unused space behind
+			size_t capacity = needed + (needed >> 1);
+
+			if (capacity > UINT32_MAX)
+				capacity = needed;
+
+			header = (cacheHeader*)N->mem->newPtr(sizeof(cacheHeader) + capacity);
+			header->capacity = (uint32_t)capacity;
+			N->nodeCache = (char*)header;
+		}
+
+		header->length = (uint32_t)textLength;
+		header->links = (uint32_t)linkCount;
+
+		cacheLink* links = (cacheLink*)(header + 1);
+		char* text = (char*)(links + linkCount);
+		const char* recorded = writer.record.data();
+		size_t from = start;
+		size_t at = 0;
+
+		for (size_t i = 0; i < linkCount; i++)
+		{
+			const Writer::cacheSpan& span = writer.spans[firstSpan + i];
+
+			memcpy(text + at, recorded + from, span.start - from);
+			at += span.start - from;
+			links[i].at = at;
+			links[i].node = span.node;
+			from = span.end;
+		}
+
+		memcpy(text + at, recorded + from, start + length - from);
+		N->nodeFlags |= CACHE_VALID;
+
+		// the spans inside are now this node's links
+		Writer::cacheSpan span = { start, start + length, N };
+		writer.spans.resize(firstSpan);
+		writer.spans.push_back(span);
+	}
+
+	writer.endRecord();
+}
@@ -53,18 +53,59 @@ THE SOFTWARE.
 #include <vector>
 #include <string>
 #include <cstring>
+#include <memory>
 #include "../heapstack/heapstack.h"
 
+// CJSON_COUNT adds to one of the calling thread's cjson::Counters when
+// built with CJSON_INSTRUMENT defined, otherwise it's nothing
+#ifdef CJSON_INSTRUMENT
+#define CJSON_COUNT(Counter, Amount) (cjson::ThreadCounters().Counter += (Amount))
+#else
+#define CJSON_COUNT(Counter, Amount) ((void)0)
+#endif
+
 enum class cjsonType : int64_t { VOIDED, NUL, OBJECT, ARRAY, INT, DBL, STR, BOOL };
 
 class cjson 
 {
 private:
 
+	// relptr stores a pointer as an offset from it's own address (0 is 
+	// NULL). Node links, names and values are relptrs so a document 
+	// laid out in one block has no absolute addresses in it, which is 
+	// what lets SaveSnapshot images be mapped back in at any address.
+	// relptr converts to and from a plain pointer so code using the 
+	// links reads the same as it would with raw pointers.
+	template <typename T>
+	class relptr
+	{
+		int64_t offset;
+
+		// worked out on integers, Ptr and this can be in different 
+		// allocations (a node and it's HeapStack block)
+		void set(T* Ptr)
+		{
+			offset = (Ptr) ? (int64_t)(intptr_t)((uintptr_t)Ptr - (uintptr_t)this) : 0;
+		}
+
+	public:
+		relptr() : offset(0) {}
+		relptr(T* Ptr) { set(Ptr); }
+		relptr(const relptr& Other) { set(Other.get()); }
+
+		relptr& operator=(const relptr& Other) { set(Other.get()); return *this; }
+		relptr& operator=(T* Ptr) { set(Ptr); return *this; }
+
+		T* get() const { return (offset) ? (T*)((uintptr_t)this + (uintptr_t)(intptr_t)offset) : NULL; }
+		operator T*() const { return get(); }
+		T* operator->() const { return get(); }
+	};
+
+	// NULL for nodes in a mapped snapshot (which are read only)
 	HeapStack* mem;
 
 	cjsonType nodeType;
-	char*   nodeName;
+	relptr<char> nodeName;
 
 	// dataUnion uses the often ignored but always awesome
 	// union feature of C++
@@ -80,7 +121,7 @@ private:
 		bool asBool;
 	};
 
-	dataUnion*  nodeData;
+	relptr<dataUnion> nodeData;
 
 	// if a doc or array it will have members
 	//std::vector< cjson* > nodeMembers;
@@ -88,15 +129,25 @@ private:
 	// members are linked list of other nodes at this
 	// document level.
 	// this is how array and object values are stored
-	cjson* membersHead;
-	cjson* membersTail;
+	relptr<cjson> membersHead;
+	relptr<cjson> membersTail;
 	int memberCount;
+	int nodeFlags; // nodeFlags_e
+
+	// memoized by hash(), valid when nodeFlags has HASH_VALID
+	uint64_t nodeHash;
+
+	// compact JSON for this node kept by Stringify when 
+	// StringifyOptions::cache is set, valid when nodeFlags has 
+	// CACHE_VALID (see Stringify_cached). Frozen arrays and objects 
+	// are never cached, for them it's the FrozenIndex (see Freeze)
+	relptr<char> nodeCache;
 
 	// next and previous sibling in to this members node list
-	cjson* siblingPrev;
-	cjson* siblingNext;
-	cjson* parentNode;
-	cjson* rootNode;
+	relptr<cjson> siblingPrev;
+	relptr<cjson> siblingNext;
+	relptr<cjson> parentNode;
+	relptr<cjson> rootNode;
 
 public:
 	struct curs
@@ -236,14 +287,21 @@ public:
 	the doucments memory manager. If you destroy the document unattached 
 	node will also become invalid.
 
-	Note: removeNode will mark a nodes type as voided. Nodes are not
-	      actually pruned fromt the document. 
-	      name and data will be NULLed.
+	Note: removeNode unlinks a node from it's parent and marks it's type
+	      as VOIDED, name and data will be NULLed. The memory it used
+		  stays in the HeapStack until the document is disposed or 
+		  compacted. The removed node keeps it's sibling links, so a 
+		  loop (or curs) can remove the node it's on and then step to 
+		  the next one.
 	      nodes fo cjsonType::VOIDED will not be emitted by Stringify
 		  VOIDED nodes will not be eimmited by functions that return
 		  std::vectors.
-		  Take care to avoid VOIDED nodes when iterating.
-		  
+
+	Compact copies the live nodes of a document into a new densely 
+	packed HeapStack (depth first, so members are next to each other in
+	memory) and disposes of the old document. All pointers into the old
+	document become invalid, use the returned document (like realloc).
+	Use it on long lived documents that are edited often.
 	-------------------------------------------------------------------------
 	*/
 
@@ -252,6 +310,13 @@ public:
 	cjson* createNode(cjsonType Type, std::string Name);
 	void   removeNode();
 
+	static cjson* Compact(cjson* Document);
+
+	// Clone copies Node and it's members into the document that Target
+	// belongs to, the copy is made in one allocation and is returned
+	// detached, add it with push. Node can be from any document.
+	static cjson* Clone(cjson* Node, cjson* Target);
+
 	cjson* hasMembers();
 	cjson* hasParent();
 
@@ -297,7 +362,9 @@ public:
 	cjson* push(const char* Value);
 	cjson* push(std::string Value);
 	cjson* push(bool Value);
-	cjson* push(cjson* Node); // push a node - returns provided node
+	// push a node, nodes in this document are moved here, nodes from 
+	// another document are copied (see Clone) - returns the pushed node
+	cjson* push(cjson* Node);
 	cjson* pushArray(); // append members with an array 
 	cjson* pushObject(); 	// append members with object/sub-docuemnt 
 
@@ -414,28 +481,1144 @@ public:
 	bool isBool(bool &Value);
 	bool isNull();
 
+	/*
+	-------------------------------------------------------------------------
+	Hashing and equality
+
+	hash returns a structural hash of a node and it's members, node names
+	are included for members but not for the node itself, so equal values
+	under different keys hash the same. With Unordered the order of 
+	object members doesn't matter (array order always does). The hash is
+	stable between runs (on the same platform), so it can be used as a 
+	cache key.
+
+	Hashes are memoized in each node and invalidated by functions that 
+	modify a node or it's members, so hashing a mostly unchanged document 
+	again only rehashes the modified paths. 
+
+	equals compares two nodes (from any document), a hash mismatch 
+	returns false without walking the members.
+	-------------------------------------------------------------------------
+	*/
+	uint64_t hash(bool Unordered = false);
+	static bool equals(cjson* A, cjson* B, bool Unordered = false);
+
+	/*
+	-------------------------------------------------------------------------
+	JSON Patch (RFC 6902) and JSON Merge Patch (RFC 7396)
+
+	Diff returns a new document (an array) of JSON Patch operations that
+	turn A into B. Identical subtrees are skipped by hash (see hash) so 
+	the work done depends mostly on the size of the change. Objects 
+	produce add/remove for missing members, arrays trim matching items 
+	from both ends first so an insert or delete is one operation.
+
+	ApplyPatch applies a JSON Patch to Document in place and supports
+	add, remove, replace, move, copy and test. It stops at the first 
+	operation that fails (or test that doesn't match) and returns false,
+	operations before it remain applied.
+
+	ApplyMergePatch merges a Merge Patch into Document in place, null 
+	members in the patch remove members from Document.
+
+	Patch values are copied into Document, Patch is not modified.
+	-------------------------------------------------------------------------
+	*/
+	static cjson* Diff(cjson* A, cjson* B);
+	static bool ApplyPatch(cjson* Document, cjson* Patch);
+	static void ApplyMergePatch(cjson* Document, cjson* Patch);
+
 	/*
 	-------------------------------------------------------------------------
 	Document import/export functions
 	-------------------------------------------------------------------------
 	*/
 
+	// Parse always returns a document, if the JSON is malformed the
+	// document contains what was read up to the error. It reads what 
+	// the original parser did: true, false and null in any case, 
+	// members set to undefined are left out and missing or trailing 
+	// commas are ignored. Use the checked Parse below for strict JSON.
+	// Strings are stored NULL terminated, so a \u0000 escape ends the
+	// string there.
 	static cjson* Parse(const char* JSON);
+	// parse Length bytes of JSON, the buffer does not need to be
+	// NULL terminated (i.e. network buffers or mmaped files). 
+	// The parser never reads beyond JSON + Length.
+	static cjson* Parse(const char* JSON, size_t Length);
 	static cjson* Parse(std::string JSON);
+	// checked parse, returns NULL if the JSON is malformed and sets
+	// ErrorOffset to the byte offset of the problem. With ValidateUTF8
+	// set strings that are not valid UTF-8 are also rejected, the check
+	// is done during the string scan rather than as a separate pass.
+	// Names and strings containing \u0000 are rejected rather than cut 
+	// short.
+	static cjson* Parse(const char* JSON, size_t Length, size_t* ErrorOffset, bool ValidateUTF8 = false);
 		
+	// output options for Stringify, StringifyCstr and Writer. 
+	// The defaults produce compact output.
+	//
+	// cache is for documents that are serialized over and over with a 
+	// few changes in between. Arrays and objects that haven't changed 
+	// since the previous Stringify keep a copy of their output in the 
+	// document's HeapStack, the next Stringify copies that rather than 
+	// formatting them again, so only the changed paths are formatted. 
+	// Only used for compact output without sortKeys. Each cached node
+	// keeps only it's own text and links to it's cached members, so the
+	// cache is about the size of the output. When a node's output 
+	// outgrows it's space it gets half as much again, the old space is
+	// only released with the document.
+	//
+	// threads formats arrays and objects with many members on several 
+	// threads, each formats a run of members into it's own buffer and 
+	// the buffers are written out in order, the output is the same as 
+	// with one thread. 0 uses a thread per core. threads is ignored when
+	// cache is in use.
+	struct StringifyOptions
+	{
+		int indent;    // spaces per level, 0 for compact output
+		bool crlf;     // end lines with \r\n rather than \n (indent > 0)
+		bool sortKeys; // emit object members sorted by key
+		bool cache;    // keep and reuse output of unchanged subtrees
+		int threads;   // threads for large arrays and objects
+
+		StringifyOptions() :
+			indent(0),
+			crlf(false),
+			sortKeys(false),
+			cache(false),
+			threads(1)
+		{}
+
+		StringifyOptions(int Indent, bool SortKeys = false, bool CRLF = false) :
+			indent(Indent),
+			crlf(CRLF),
+			sortKeys(SortKeys),
+			cache(false),
+			threads(1)
+		{}
+	};
+
+	// a named node (a member, not a document) is written as a 
+	// "name":value fragment, use Writer::node for just the value.
 	// returns char* you must call delete[] on the result
-	static char* cjson::StringifyCstr(cjson* N);
-	// returns std::string (calls char* verison internally)
-	// this version is slightly slower than the char* version
-	// on multi-megabyte json documents
-	static std::string cjson::Stringify(cjson* N);
-
-	// completely free a document and all it's children
-	// all nodes in the document become invalid immediately
+	static char* StringifyCstr(cjson* N, const StringifyOptions& Options = StringifyOptions());
+	// returns std::string
+	static std::string Stringify(cjson* N, const StringifyOptions& Options = StringifyOptions());
+
+	/*
+	-------------------------------------------------------------------------
+	Binary encoding
+
+	ToBinary encodes a node (and it's members) as compact binary, 
+	FromBinary rebuilds a document from it without any text scanning
+	or number conversion. 
+
+	Format: "CJB1", flags byte, optional key dictionary, then one value.
+	Each value starts with a tag byte, lengths and counts are varints, 
+	integers are zigzag varints (0 to 63 are packed into the tag byte), 
+	doubles are 8 raw bytes (little endian hosts). With KeyDictionary 
+	each distinct key is stored once and members refer to it by index, 
+	FromBinary then shares one copy of each key between nodes.
+
+	FromBinary returns NULL if the data is not valid cjson binary or 
+	nests deeper than 1024 arrays and objects.
+	-------------------------------------------------------------------------
+	*/
+	static std::string ToBinary(cjson* N, bool KeyDictionary = true);
+	static cjson* FromBinary(const char* Data, size_t Length);
+
+	/*
+	-------------------------------------------------------------------------
+	Snapshots
+
+	SaveSnapshot writes a document to Path as a position independent 
+	image. Nodes, names and values are laid out in one block (depth 
+	first, so members sit next to each other) and every link in the 
+	image is an offset rather than a pointer.
+
+	LoadSnapshot maps the image read only (mmap or MapViewOfFile) and 
+	returns it's root node, there is no parsing and nothing is copied,
+	pages are read in by the OS as nodes are touched. The result works 
+	with find, at, xPath, cursor, Stringify, etc. Functions that would 
+	modify a mapped document do nothing and return NULL. Call 
+	DisposeDocument to unmap it.
+
+	Snapshots are only portable between builds with the same node 
+	layout and byte order, LoadSnapshot returns NULL if they differ or 
+	the file is not a snapshot.
+
+	Before it's used the image is walked once to check that every link,
+	name and value lands inside it and strings are terminated, so a 
+	truncated or corrupt file returns NULL. That reads the whole file,
+	pass Trusted for files only your own code writes to skip the check 
+	(and only touch the pages used).
+	-------------------------------------------------------------------------
+	*/
+	static bool SaveSnapshot(cjson* Document, const char* Path);
+	static cjson* LoadSnapshot(const char* Path, bool Trusted = false);
+
+	// completely free a document and all it's children (or unmap a 
+	// snapshot) all nodes in the document become invalid immediately
 	static void DisposeDocument(cjson* Document);
 	// create a root node (with heapstack object).
 	static cjson* MakeDocument();
 
+	/*
+	-------------------------------------------------------------------------
+	Writer - stream JSON out without building a document.
+
+	Stringify is built on Writer so output is identical, including the
+	pretty printing options. Output is
+	collected in a small buffer inside the Writer and handed to a Sink 
+	(or appended to a std::string) each time the buffer fills, commas
+	are inserted automatically. The Writer makes no allocations of it's 
+	own (unless StringifyOptions::cache is set) so a Writer on the stack
+	with a Sink is allocation free.
+
+	i.e.
+
+	std::string out;
+	cjson::Writer writer(out);
+
+	writer.beginObject();
+	writer.key("id");
+	writer.value(int64_t(42));
+	writer.key("tags");
+	writer.beginArray();
+	writer.value("a");
+	writer.value("b");
+	writer.endArray();
+	writer.endObject();
+	writer.flush(); // or let the Writer go out of scope
+
+	-------------------------------------------------------------------------
+	*/
+	class Writer
+	{
+	public:
+		typedef void (*Sink)(void* Context, const char* Data, size_t Length);
+
+		Writer(std::string& Output, const StringifyOptions& Options = StringifyOptions());
+		Writer(Sink Output, void* Context, const StringifyOptions& Options = StringifyOptions());
+		~Writer(); // calls flush
+
+		void beginObject();
+		void endObject();
+		void beginArray();
+		void endArray();
+
+		void key(const char* Key);
+		void key(const char* Key, size_t Length);
+		void key(const std::string& Key);
+
+		void value(int64_t Value);
+		void value(int Value);
+		void value(double Value);
+		void value(bool Value);
+		void value(const char* Value);
+		void value(const char* Value, size_t Length);
+		void value(const std::string& Value);
+		void null();
+
+		// write an existing node and it's members. The node's own name is
+		// not written, call key() first when inside an object
+		void node(cjson* N);
+
+		// hand buffered output to the Sink or std::string
+		void flush();
+
+	private:
+		std::string* output;
+		Sink sink;
+		void* context;
+		StringifyOptions options;
+		bool comma;    // next value at this level needs a comma
+		bool afterKey; // next value follows a key
+		int depth;
+		char* writer;
+		char buffer[4096];
+
+		// output captured for cached subtrees (see Stringify_cached), 
+		// recordings nest, recordFrom is where uncaptured output starts
+		std::string record;
+		int recordDepth;
+		char* recordFrom;
+
+		// cached nodes written (or just cached) inside the recordings, 
+		// where their output is in record
+		struct cacheSpan
+		{
+			size_t start;
+			size_t end;
+			cjson* node;
+		};
+
+		std::vector< cacheSpan > spans;
+
+		size_t beginRecord();
+		void syncRecord();
+		void endRecord();
+		bool caching();
+
+		void reserve(size_t Length);
+		void separator();
+		void newLine();
+		void text(const char* Text, size_t Length);
+		void escaped(const char* Text, size_t Length);
+
+		Writer(const Writer&);
+		Writer& operator=(const Writer&);
+
+		friend class cjson;
+	};
+
+	/*
+	-------------------------------------------------------------------------
+	Event (SAX style) parsing.
+
+	ParseEvents scans JSON with the same Reader used by Parse but 
+	builds no document, instead the handler is called for each token.
+	Strings and keys are passed unescaped, as pointers into the JSON 
+	buffer, or into a scratch buffer for strings containing escapes
+	(either way they are not NULL terminated). Handler calls are resolved at compile time
+	so they inline into the scanner. 
+
+	SaxHandler provides do nothing versions of every event, derive from
+	it and declare only the events you need.
+
+	i.e.
+
+	struct CountInts : public cjson::SaxHandler
+	{
+		int count = 0;
+		bool onInt(int64_t Value) { ++count; return true; }
+	};
+
+	CountInts counter;
+	cjson::ParseEvents(JSON, length, counter);
+
+	returns true if a complete well formed document was scanned.
+	If errorOffset is provided it is set to the byte offset where
+	scanning stopped. If ValidateUTF8 is set strings that are not
+	valid UTF-8 stop the scan.
+	-------------------------------------------------------------------------
+	*/
+	struct SaxHandler
+	{
+		bool onStartObject() { return true; }
+		bool onEndObject() { return true; }
+		bool onStartArray() { return true; }
+		bool onEndArray() { return true; }
+		bool onKey(const char*, size_t) { return true; }
+		bool onString(const char*, size_t) { return true; }
+		bool onInt(int64_t) { return true; }
+		bool onDouble(double) { return true; }
+		bool onBool(bool) { return true; }
+		bool onNull() { return true; }
+	};
+
+	template <typename Handler>
+	static bool ParseEvents(const char* JSON, size_t Length, Handler& handler, size_t* errorOffset = NULL, bool ValidateUTF8 = false);
+
+	// well-formedness check. Runs the Reader without building anything,
+	// strings are not decoded and numbers are not converted, nothing is
+	// allocated for documents nested less than 1024 deep.
+	// returns true for a complete well formed document, if not 
+	// ErrorOffset (if provided) is set to the byte offset of the problem.
+	static bool Validate(const char* JSON, size_t Length, size_t* ErrorOffset = NULL, bool ValidateUTF8 = false);
+
+	/*
+	-------------------------------------------------------------------------
+	Typed binding - read JSON straight into C++ structs (and back)
+
+	Declare the members of a struct that map to JSON keys once with 
+	CJSON_BIND (at namespace scope, in the same namespace as the struct)
+	then use ParseInto and StringifyFrom. No document is built, values
+	are converted as they are scanned.
+
+	i.e.
+
+	struct Point
+	{
+		int64_t x = 0;
+		int64_t y = 0;
+		std::string label;
+		std::vector< double > weights;
+	};
+
+	CJSON_BIND(Point,
+		CJSON_FIELD(x),
+		CJSON_FIELD(y),
+		CJSON_FIELD_AS("name", label),
+		CJSON_FIELD(weights))
+
+	Point p;
+	if (cjson::ParseInto(json, p)) 
+		...
+	std::string out = cjson::StringifyFrom(p);
+
+	Members can be int64_t, int, double, float, bool, std::string, 
+	std::vector of any of these or of another bound struct (nested 
+	objects). Key hashes are computed at compile time, matching a 
+	scanned key is a hash and one table probe (the table is sized 
+	so keys don't collide when possible).
+
+	Keys with no member are skipped, members with no key (or a null 
+	value) are left as they are. A value of the wrong type fails the 
+	parse, integers are accepted for double and float members.
+
+	ParseInto returns false if the JSON is malformed, doesn't fit T or
+	nests deeper than 1024 arrays and objects, ErrorOffset (if provided)
+	is set to where reading stopped. Members read before the problem 
+	keep their new values.
+	-------------------------------------------------------------------------
+	*/
+	class BindReader;
+
+	struct BindField
+	{
+		typedef bool (*Read)(BindReader& reader, void* Object);
+		typedef void (*Write)(Writer& writer, const void* Object);
+
+		const char* key;
+		size_t length;
+		uint64_t hash;
+		Read read;
+		Write write;
+
+		// FNV-1a, the same hash is used on scanned keys (BindTable::find)
+		static constexpr uint64_t keyHash(const char* Key, uint64_t Hash = 0xcbf29ce484222325ULL)
+		{
+			return (*Key) ? keyHash(Key + 1, (Hash ^ (unsigned char)*Key) * 0x100000001b3ULL) : Hash;
+		}
+
+		static constexpr size_t keyLength(const char* Key)
+		{
+			return (*Key) ? 1 + keyLength(Key + 1) : 0;
+		}
+
+		constexpr BindField(const char* Key, Read ReadMember, Write WriteMember) :
+			key(Key),
+			length(keyLength(Key)),
+			hash(keyHash(Key)),
+			read(ReadMember),
+			write(WriteMember)
+		{}
+	};
+
+	// the fields of a bound struct with a slot table for key lookup,
+	// built once per type by CJSON_BIND
+	class BindTable
+	{
+	public:
+		BindTable(const BindField* Fields, size_t Count);
+
+		const BindField* find(const char* Key, size_t Length) const;
+
+		const BindField* fields;
+		size_t count;
+
+	private:
+		std::vector< int > slots;
+		size_t mask;
+	};
+
+	// recursive descent reader used by ParseInto, built on the same 
+	// string and number scanners as Parse
+	class BindReader
+	{
+	public:
+		BindReader(const char* JSON, size_t Length);
+
+		bool object(const BindTable& Table, void* Object);
+		bool beginArray(bool& Empty);
+		bool arrayNext(bool& More);
+		bool integer(int64_t& Value);
+		bool real(double& Value);
+		bool boolean(bool& Value);
+		bool string(std::string& Value);
+		bool null(); // consumes a null if there is one
+
+		bool finish(); // true if only whitespace remains
+		size_t offset();
+
+	private:
+		const char* start;
+		const char* cursor;
+		const char* end;
+		std::string scratch;
+		int depth; // open objects and arrays
+
+		void space();
+		bool expect(char C);
+		bool text(const char*& Text, size_t& Length);
+		int number(int64_t& Int, double& Dbl);
+		bool skip();
+	};
+
+	// reads and writes one member type, the primary template handles 
+	// bound structs, specializations follow the cjson class
+	template <typename M>
+	struct BindValue;
+
+	// reads and writes member Member of T, referenced by BindField
+	template <typename T, typename M, M T::*Member>
+	struct BindAccess
+	{
+		static bool read(BindReader& reader, void* Object)
+		{
+			// null leaves the member as it is
+			if (reader.null())
+				return true;
+			return BindValue< M >::read(reader, ((T*)Object)->*Member);
+		}
+
+		static void write(Writer& writer, const void* Object)
+		{
+			BindValue< M >::write(writer, ((const T*)Object)->*Member);
+		}
+	};
+
+	static void BindWriteObject(Writer& writer, const BindTable& Table, const void* Object);
+
+	template <typename T>
+	static bool ParseInto(const char* JSON, size_t Length, T& Object, size_t* ErrorOffset = NULL);
+	template <typename T>
+	static bool ParseInto(const std::string& JSON, T& Object, size_t* ErrorOffset = NULL);
+	template <typename T>
+	static std::string StringifyFrom(const T& Object, const StringifyOptions& Options = StringifyOptions());
+
+	/*
+	-------------------------------------------------------------------------
+	Schema - compiled JSON Schema validation
+
+	Compile turns a JSON Schema (a document from Parse) into a flat 
+	program, an array of rules that refer to each other by index, with 
+	the properties of each object rule in a hash table keyed by 
+	precomputed hashes. The schema document is not used after Compile.
+
+	A program can check an existing node, check JSON text without 
+	building a document, or run inside Parse so the document is built
+	and checked in the same pass. Every value is visited once, the work 
+	at each value is the rules that apply to it (more than one when 
+	allOf, anyOf, oneOf or not are used).
+
+	i.e.
+
+	std::string error;
+	cjson::Schema* schema = cjson::Schema::Compile(schemaDoc, &error);
+
+	if (!schema->validate(doc, &error))
+		printf("%s\n", error.c_str()); // i.e. "/items/3/price: minimum"
+
+	cjson* doc = schema->parse(json, length); // NULL if malformed or invalid
+	delete schema;
+
+	Supported keywords: type, enum, const, minimum, maximum, 
+	exclusiveMinimum, exclusiveMaximum (number, or boolean as in draft 4), 
+	multipleOf, minLength, maxLength, pattern (ECMAScript std::regex), 
+	items (schema or array), prefixItems, additionalItems, minItems, 
+	maxItems, uniqueItems, properties, required, additionalProperties,
+	minProperties, maxProperties, allOf, anyOf, oneOf, not and $ref 
+	(local only, "#" or a JSON Pointer like "#/definitions/name"). 
+	true and false are accepted as schemas. Other keywords are ignored.
+
+	pattern is matched with std::regex, which uses stack in proportion
+	to the length of the string, so a string over 1024 bytes that has 
+	to be matched fails the whole document (inside not, anyOf and oneOf
+	as well) without being matched.
+
+	enum, const and uniqueItems compare values exactly (a hash picks 
+	the candidates), numbers compare by value (1 equals 1.0) and object
+	members in any order.
+
+	Compile returns NULL if the schema can't be compiled and sets Error.
+	validate and parse set Error to the JSON Pointer of the failing value
+	and the keyword that failed, ErrorOffset to where the JSON scan 
+	stopped. A Schema can be used by several threads at once.
+	-------------------------------------------------------------------------
+	*/
+	class Schema
+	{
+	public:
+		static Schema* Compile(cjson* Document, std::string* Error = NULL);
+		~Schema();
+
+		bool validate(cjson* Node, std::string* Error = NULL);
+		bool validate(const char* JSON, size_t Length, size_t* ErrorOffset = NULL, std::string* Error = NULL);
+		cjson* parse(const char* JSON, size_t Length, size_t* ErrorOffset = NULL, std::string* Error = NULL);
+
+	private:
+		struct Program;
+		struct Compiler;
+		class Check;
+		struct Checked; // Reader handler for parse, a Builder and a Check
+		friend class cjson;
+
+		Program* program;
+
+		Schema(Program* Compiled);
+		Schema(const Schema&);
+		Schema& operator=(const Schema&);
+	};
+
+	/*
+	-------------------------------------------------------------------------
+	Query - compiled path queries with wildcards, recursive descent and
+	filters
+
+	Compile turns an expression into a plan that can be run any number
+	of times (and by several threads at once). Running it walks the 
+	member lists directly, nothing is allocated, matches are passed to a 
+	callback or stored in a buffer as they are found (in document order
+	for each step).
+
+	Steps are separated by / as in xPath:
+
+	  /name         member called name, or the item at name in an array
+	                when name is a number
+	  / *           every member (or array item), written without the space
+	  //step        step applied to this node and all nodes below it
+	  [?filter]     every member (or array item) that passes filter, may 
+	                follow a step directly, i.e. /orders[?total > 10]
+
+	filters compare a field of the member with a literal or test that 
+	the field exists:
+
+	  [?price > 10]  [?address/city == "Paris"]  [?@ != null]  [?sku]
+
+	@ is the member itself. Operators are == != < <= > >=, literals are 
+	numbers, "strings" (JSON escapes) or 'strings', true, false and null. 
+	Numbers compare by value, strings by bytes, true/false/null only 
+	with == and !=. A field that's missing or of another type never 
+	matches (except with !=). Use ~1 for / and ~0 for ~ in names.
+
+	i.e.
+
+	cjson::Query* skus = cjson::Query::Compile("//items[?qty > 1]/sku");
+	cjson* found[64];
+	size_t count = skus->run(doc, found, 64);
+
+	Compile returns NULL if the expression is malformed and sets Error.
+	-------------------------------------------------------------------------
+	*/
+	class Query
+	{
+	public:
+		// return false to stop the query
+		typedef bool (*Callback)(void* Context, cjson* Node);
+
+		static Query* Compile(const char* Expression, std::string* Error = NULL);
+		~Query();
+
+		// calls callback for each match, returns the number of matches
+		size_t run(cjson* Node, Callback callback, void* Context);
+		// stores up to Capacity matches in Results, returns the number stored
+		size_t run(cjson* Node, cjson** Results, size_t Capacity);
+		// first match or NULL
+		cjson* first(cjson* Node);
+
+	private:
+		struct Plan;
+		struct Run;
+
+		Plan* plan;
+
+		Query(Plan* Compiled);
+		Query(const Query&);
+		Query& operator=(const Query&);
+	};
+
+	/*
+	-------------------------------------------------------------------------
+	Columnar extraction
+
+	ExtractColumns reads fields from an array of objects (records) into 
+	one contiguous buffer per field, in a single pass over the array.
+
+	Records that share a layout have each key at the same position, so
+	the position a key was found at is kept in it's Column and checked 
+	first on the next record, a key is only searched for when it has 
+	moved. Reading a field is usually one name compare.
+
+	i.e.
+
+	std::vector< cjson::Column > columns = {
+		cjson::Column("price", cjsonType::DBL),
+		cjson::Column("ts", cjsonType::INT),
+		cjson::Column("sku", cjsonType::STR) };
+
+	size_t rows = cjson::ExtractColumns(doc->find("rows"), columns);
+
+	for (size_t i = 0; i < rows; i++)
+		total += columns[0].doubles[i];
+
+	Columns are INT (ints), DBL (doubles), BOOL (ints, 0 or 1) or STR 
+	(text holds the values, each ends with a NULL and starts at 
+	offsets[row]). DBL columns take integers, INT columns take doubles 
+	with no fraction that fit an int64_t. Rows without the key, with 
+	null, with a value of another type (or out of range), or that aren't 
+	objects store 0 (or "") and have valid[row] set to 0. Buffers are replaced on each call, returns the 
+	number of rows.
+	-------------------------------------------------------------------------
+	*/
+	struct Column
+	{
+		const char* key;
+		cjsonType type;
+
+		std::vector< int64_t > ints;
+		std::vector< double > doubles;
+		std::string text;
+		std::vector< size_t > offsets;
+		std::vector< uint8_t > valid;
+
+		int position; // member position key was last found at
+
+		Column(const char* Key, cjsonType Type) :
+			key(Key),
+			type(Type),
+			position(0)
+		{}
+
+		const char* string(size_t Row) const { return text.c_str() + offsets[Row]; }
+	};
+
+	static size_t ExtractColumns(cjson* Array, std::vector< Column >& Columns);
+
+	/*
+	-------------------------------------------------------------------------
+	Parallel traversal
+
+	ParallelForEach calls fn(member, index) for each member of an array
+	or object, with the members shared out between Threads threads (0 
+	uses a thread per core). Threads take runs of members as they finish
+	the last so uneven work balances out. Returns when every call has 
+	returned.
+
+	i.e.
+
+	std::vector< double > totals(orders->size());
+
+	cjson::ParallelForEach(orders, [&](cjson* order, size_t index) {
+		totals[index] = order->xPath(std::string("total"), 0.0);
+	});
+
+	fn runs on several threads at once. It can read the document 
+	(including hash of it's own member, and Stringify without 
+	StringifyOptions::cache) but must not add, remove or replace nodes 
+	or write cached output, the document's HeapStack isn't thread safe.
+	hash memoizes in the nodes it visits, so calls must not hash the 
+	same nodes. fn must not throw.
+	-------------------------------------------------------------------------
+	*/
+	typedef void (*EachCallback)(void* Context, cjson* Member, size_t Index);
+
+	static void ParallelForEach(cjson* Node, EachCallback callback, void* Context, int Threads = 0);
+
+	template <typename Fn>
+	static void ParallelForEach(cjson* Node, Fn fn, int Threads = 0)
+	{
+		ParallelForEach(Node, [](void* Context, cjson* Member, size_t Index) {
+			(*(Fn*)Context)(Member, Index);
+		}, &fn, Threads);
+	}
+
+	/*
+	-------------------------------------------------------------------------
+	Frozen documents
+
+	Freeze compacts a document (see Compact) and builds read optimized 
+	indexes next to it's nodes. Arrays and objects get a contiguous 
+	array of their members so at doesn't walk the list, and objects get
+	a hash table of their keys for find (and so xPath, isNode, etc). 
+	Hashes are memoized up front. Like Compact the document passed in 
+	is disposed, use the returned one.
+
+	A frozen document is read only like a mapped snapshot, functions 
+	that would modify it do nothing and return NULL. Reading it never 
+	writes to it, so any number of threads can read it at once without 
+	locking. Clone it into another document for a mutable copy.
+
+	Published holds the current version of a frozen document for readers
+	on other threads. get returns a reference counted handle, publish 
+	freezes a new version and swaps it in atomically. Readers still 
+	holding the old version keep using it, it is disposed when the last 
+	handle to it is released.
+
+	i.e.
+
+	cjson::Published config(cjson::Parse(text));
+
+	// readers
+	std::shared_ptr< cjson > current = config.get();
+	int64_t port = current->xPath(std::string("server/port"), (int64_t)80);
+
+	// writer
+	config.publish(cjson::Parse(newText));
+	-------------------------------------------------------------------------
+	*/
+	static cjson* Freeze(cjson* Document);
+	bool frozen();
+
+	class Published
+	{
+	public:
+		Published(cjson* Document = NULL);
+
+		std::shared_ptr< cjson > get() const;
+		void publish(cjson* Document);
+
+	private:
+		std::shared_ptr< cjson > current;
+
+		Published(const Published&);
+		Published& operator=(const Published&);
+	};
+
+	/*
+	-------------------------------------------------------------------------
+	ConfigCache - parsed config files shared by path
+
+	get returns the document for a file as a frozen, reference counted 
+	handle (see Freeze), the file is read and parsed the first time it 
+	is asked for. After that get is a lookup, the file isn't touched.
+
+	refresh checks each file's identity (device, inode, size and 
+	modified time) and reads only the ones that changed, each new 
+	version replaces the old one for later calls to get. Readers still 
+	holding the old version keep using it, it is disposed when the last 
+	handle to it is released. If a changed file can't be read or isn't 
+	valid JSON the last good version is kept and it is tried again on
+	the next refresh.
+
+	A ConfigCache made with an Interval (milliseconds) runs refresh on 
+	a background thread, so reloading is kept off the callers path. 
+	With 0 refresh is only run when it is called. A ConfigCache can be 
+	used by several threads at once.
+
+	i.e.
+
+	cjson::ConfigCache configs(5000);
+
+	std::shared_ptr< cjson > config = configs.get("/etc/service.json");
+	-------------------------------------------------------------------------
+	*/
+	class ConfigCache
+	{
+	public:
+		ConfigCache(int Interval = 0);
+		~ConfigCache();
+
+		std::shared_ptr< cjson > get(const char* Path, std::string* Error = NULL);
+		size_t refresh();
+
+	private:
+		struct Files;
+		Files* files;
+
+		ConfigCache(const ConfigCache&);
+		ConfigCache& operator=(const ConfigCache&);
+	};
+
+	/*
+	-------------------------------------------------------------------------
+	Stats - what a document is made of and what it costs
+
+	Stats walks Node once and counts it's nodes by type, the bytes used
+	by node structs, names, string values and scalar (INT, DBL, BOOL) 
+	values, how deep it nests and it's widest object and longest array.
+	Names shared between nodes (see Compact) are counted once.
+
+	For a document root arenaBytes is what it's HeapStack has handed 
+	out and unusedBytes is the part of that not used by live nodes, i.e.
+	removed nodes, replaced values and names, Stringify caches, Freeze 
+	indexes and padding. A Compact document has almost none. Both are
+	0 for other nodes and mapped snapshots.
+
+	depth is 0 for a value, 1 for an array or object of values, etc.
+	-------------------------------------------------------------------------
+	*/
+	struct DocumentStats
+	{
+		size_t nodes;
+		size_t types[8]; // by cjsonType
+
+		size_t nodeBytes;
+		size_t nameBytes;
+		size_t stringBytes;
+		size_t scalarBytes;
+
+		size_t arenaBytes;
+		size_t unusedBytes;
+
+		int depth;
+		size_t widestObject;
+		size_t longestArray;
+	};
+
+	static DocumentStats Stats(cjson* Node);
+
+	/*
+	-------------------------------------------------------------------------
+	Instrumentation
+
+	When built with CJSON_INSTRUMENT defined Parse, Stringify and find 
+	count what they do into Counters kept for each thread. Without it
+	the counting compiles to nothing and the Counters stay 0.
+
+	ThreadCounters returns the running totals for the calling thread, 
+	reset them with ThreadCounters() = cjson::Counters().
+
+	SetInstrumentHook installs a function that is called after each 
+	Parse and Stringify, on the thread that made the call, with Phase
+	("parse" or "stringify") and the Counters for just that call. Use 
+	it to log payloads that are slow or unusually large. The hook is 
+	shared by all threads, set it before they start using cjson.
+
+	Members formatted by worker threads (StringifyOptions::threads) are
+	counted on those threads.
+	-------------------------------------------------------------------------
+	*/
+	struct Counters
+	{
+		uint64_t parseBytes; // JSON scanned by Parse
+		uint64_t parseNodes; // nodes created by Parse
+		uint64_t parseHeapBytes; // HeapStack used by documents Parse built
+		uint64_t parseNanoseconds;
+
+		uint64_t stringifyNodes;
+		uint64_t stringifyBytes;
+		uint64_t stringifyNanoseconds;
+
+		uint64_t findCompares; // names compared by find (and so set)
+		uint64_t documents; // HeapStacks created by MakeDocument
+
+		Counters() :
+			parseBytes(0),
+			parseNodes(0),
+			parseHeapBytes(0),
+			parseNanoseconds(0),
+			stringifyNodes(0),
+			stringifyBytes(0),
+			stringifyNanoseconds(0),
+			findCompares(0),
+			documents(0)
+		{}
+	};
+
+	typedef void (*InstrumentHook)(void* Context, const char* Phase, const Counters& Call);
+
+	static Counters& ThreadCounters();
+	static void SetInstrumentHook(InstrumentHook Hook, void* Context);
+
+private:
+	// BitStack - container nesting for Reader, one bit per level 
+	// (set for objects). The first 1024 levels are stored inline.
+	class BitStack
+	{
+	public:
+		BitStack() : depth(0) {}
+
+		void push(bool Bit)
+		{
+			size_t index = depth >> 6;
+			uint64_t mask = (uint64_t)1 << (depth & 63);
+
+			if (index >= inlineWords && overflow.size() <= index - inlineWords)
+				overflow.push_back(0);
+
+			uint64_t& bits = word(index);
+			bits = (Bit) ? (bits | mask) : (bits & ~mask);
+			++depth;
+		}
+
+		void pop() { --depth; }
+		bool top() { return (word((depth - 1) >> 6) >> ((depth - 1) & 63)) & 1; }
+		bool empty() { return depth == 0; }
+		size_t size() { return depth; }
+
+	private:
+		static const size_t inlineWords = 16;
+
+		uint64_t words[inlineWords];
+		std::vector< uint64_t > overflow;
+		size_t depth;
+
+		uint64_t& word(size_t index) 
+		{ 
+			return (index < inlineWords) ? words[index] : overflow[index - inlineWords]; 
+		}
+	};
+
+	// Validator - Reader handler for Validate. Decodes() tells the Reader
+	// at compile time that the Validator doesn't need decoded strings or
+	// converted numbers.
+	struct Validator : public SaxHandler {};
+
+	template <typename Handler>
+	static bool Decodes(Handler*) { return true; }
+	static bool Decodes(Validator*) { return false; }
+
+	// Lenient() tells the Reader to accept what the unchecked Parse 
+	// always has (see Parse), only a Builder can ask for it. An 
+	// undefined value calls Undefined() instead of an event.
+	struct Builder;
+	template <typename Handler>
+	static bool Lenient(Handler*) { return false; }
+	static bool Lenient(Builder* builder);
+	template <typename Handler>
+	static bool Undefined(Handler*) { return false; }
+	static bool Undefined(Builder* builder);
+	// Terminates() tells the Reader the handler keeps strings NULL 
+	// terminated, so a decoded NULL would cut them short and is an error.
+	template <typename Handler>
+	static bool Terminates(Handler*) { return false; }
+	static bool Terminates(Builder* builder);
+	static bool Terminates(Schema::Checked* checked);
+	// hash of a member name for Builder::dedupe
+	static uint64_t KeyHash(const char* Text, size_t Length);
+
+public:
+	/*
+	-------------------------------------------------------------------------
+	Reader - the JSON scanner used by Parse, Parser, ParseEvents and Validate.
+
+	Reader walks JSON text and calls a Handler for each token it finds.
+	A Handler is any class with these members (return false to stop):
+
+		bool onStartObject();
+		bool onEndObject();
+		bool onStartArray();
+		bool onEndArray();
+		bool onKey(const char* Text, size_t Length);
+		bool onString(const char* Text, size_t Length);
+		bool onInt(int64_t Value);
+		bool onDouble(double Value);
+		bool onBool(bool Value);
+		bool onNull();
+
+	scan() may be called repeatedly with consecutive pieces of a 
+	document. When More is true a token that runs into the end of the
+	piece (i.e. a string without it's closing quote) is not consumed, 
+	scan returns the number of bytes it did consume and the remainder
+	must be presented again at the start of the next call.
+	-------------------------------------------------------------------------
+	*/
+	template <typename Handler>
+	class Reader
+	{
+	public:
+		// ValidateUTF8 - reject strings that are not valid UTF-8
+		Reader(Handler& handler, bool ValidateUTF8 = false);
+
+		size_t scan(const char* JSON, size_t Length, bool More);
+
+		// a complete top level value has been read
+		bool done();
+		// a syntax error was found or the handler stopped the scan
+		bool failed();
+		// byte offset (from the start of the first scan) where scanning 
+		// stopped, when failed this is the offset of the bad token
+		size_t errorOffset();
+
+	private:
+		enum { VALUE, VALUE_OR_CLOSE, KEY, KEY_OR_CLOSE, COLON, COMMA_OR_CLOSE, DONE, FAILED };
+
+		Handler& handler;
+		BitStack stack; // open containers, set for objects
+		std::string scratch; // unescaped text for strings with escapes
+		bool validateUtf8;
+		int state;
+		size_t position; // bytes consumed by previous scans
+
+		void afterValue();
+	};
+
+private:
+	// Builder - Reader handler that builds a cjson document
+	struct Builder
+	{
+		cjson* root;
+		cjson* current;
+		char* pendingName;
+		uint64_t pendingHash;
+		// (name hash, member) for the members of the open objects, the 
+		// innermost object's start at keyMarks.back(). Used by dedupe.
+		std::vector< std::pair< uint64_t, cjson* > > keys;
+		std::vector< size_t > keyMarks;
+		std::vector< uint64_t > table; // hash table used by dedupe
+		bool lenient; // see Lenient
+
+		Builder();
+
+		cjson* add(cjsonType Type, size_t DataSize = 0);
+		bool container(cjsonType Type);
+		// a repeated key replaces the earlier member (last value wins,
+		// in the place of the first) like set() does
+		void dedupe(cjson* Object, size_t First);
+
+		bool onStartObject();
+		bool onEndObject();
+		bool onStartArray();
+		bool onEndArray();
+		bool onKey(const char* Text, size_t Length);
+		bool onString(const char* Text, size_t Length);
+		bool onInt(int64_t Value);
+		bool onDouble(double Value);
+		bool onBool(bool Value);
+		bool onNull();
+	};
+
+public:
+	/*
+	-------------------------------------------------------------------------
+	Parser - incremental (push) parser.
+
+	Feed a document to the parser as it arrives, the document is built
+	as data is fed, tokens split between pieces (i.e. in the middle of
+	a string or number) are carried over to the next call to feed. 
+
+	i.e.
+
+	cjson::Parser parser; // or parser(true) to validate UTF-8
+
+	while (readChunk(chunk, length))
+		if (!parser.feed(chunk, length))
+			break; // syntax error
+
+	cjson* doc = parser.finish();
+
+	finish returns the document (even if incomplete), the caller owns
+	it and must call DisposeDocument. Use failed() and errorOffset()
+	to check the result.
+	-------------------------------------------------------------------------
+	*/
+	class Parser
+	{
+	public:
+		Parser(bool ValidateUTF8 = false);
+		~Parser();
+
+		// returns false once a syntax error has been found
+		bool feed(const char* JSON, size_t Length);
+		cjson* finish();
+
+		bool failed();
+		size_t errorOffset();
+
+	private:
+		Builder builder;
+		Reader< Builder > reader;
+		std::string carry; // partial token from the end of the last feed
+
+		static size_t carryLength(const std::string& carry, const char* JSON, size_t Length);
+
+		Parser(const Parser&);
+		Parser& operator=(const Parser&);
+	};
+
 
 private:
 	// Each node can have children. These are implemented as 
@@ -445,12 +1628,93 @@ private:
 	// the node that calls link as well as maintain siblingNext
 	// and siblingPrev for newNode and it's siblings.
 	void Link(cjson* newNode);
-	static cjson* ParseBranch(cjson* N, char* &cursor);
+	// LinkBefore is Link but inserts newNode before Before 
+	// (or at the end when Before is NULL)
+	void LinkBefore(cjson* newNode, cjson* Before);
+	// Unlink removes this node from it's parents members list
+	void Unlink();
+
+	// create a detached node of Type with DataSize bytes for nodeData
+	// allocated in the same block as the node. Used when building 
+	// documents to save an allocation per value.
+	cjson* createValueNode(cjsonType Type, size_t DataSize);
+
+	// scanner helpers used by Reader.
+	// ScanQuote returns the position of the closing quote of a string
+	// that begins at cursor, or of an (illegal) control character, or of 
+	// invalid UTF-8 when Validate is set, or end.
+	// Escaped is set if the string contains escape sequences. 
+	// Unescape decodes escape sequences into Dest (which must hold 
+	// Length bytes), returns false for a bad escape sequence.
+	// ValidEscapes checks escape sequences without decoding them.
+	// ParseNumber converts the number in [start, end) returning 1 for INT, 
+	// 2 for DBL and 0 if invalid, if Convert is false the number is only
+	// validated.
+	static const char* ScanQuote(const char* cursor, const char* end, bool &Escaped, bool Validate = false);
+	static bool Unescape(const char* Text, size_t Length, char* Dest, size_t &DestLength);
+	static bool ValidEscapes(const char* Text, size_t Length);
+	static int ParseNumber(const char* start, const char* end, int64_t &Int, double &Dbl, bool Convert = true);
 
 	// funtion used by xPath functions
 	cjson* GetNodeByPath(std::string Path);
-	// worker used stringifyC
-	void Stringify_worker(cjson* N, char* &writer);
+	// worker used by Stringify, StringifyCstr and Writer::node
+	static void Stringify_worker(cjson* N, Writer& writer);
+	static void Stringify_members(cjson* N, Writer& writer);
+	static void Stringify_cached(cjson* N, Writer& writer);
+	static void Stringify_copy(cjson* N, Writer& writer);
+	static void Stringify_parallel(cjson* N, std::vector< cjson* >& Members, Writer& writer);
+
+	// workers used by ToBinary and FromBinary
+	struct BinaryDecoder;
+	void Binary_worker(std::string& out, void* Dictionary);
+	bool FromBinary_worker(BinaryDecoder& decoder, cjsonType Type);
+
+	// workers used by hash, equals and Diff, Hashes (when not NULL) holds 
+	// the hashes of read only nodes worked out so far
+	uint64_t hash_worker(bool Unordered, void* Hashes);
+	static bool equals_worker(cjson* A, cjson* B, bool Unordered, void* Hashes);
+
+	// workers used by Diff, ApplyPatch and ApplyMergePatch
+	static void Diff_worker(cjson* A, cjson* B, std::string& Path, cjson* Patch, void* Hashes);
+	bool patchAdd(const std::vector< std::string >& Tokens, cjson* Value);
+	static void patchReplace(cjson* Node, cjson* Value);
+	void MergePatch_worker(cjson* Patch);
+
+	// worker used by Stats
+	void Stats_worker(DocumentStats& Stats, void* Names, int Depth);
+
+	// worker used by Compact and SaveSnapshot
+	struct Packer;
+	cjson* Pack_worker(Packer& packer, cjson* Root);
+	// checks the nodes of a snapshot image in [Begin, End), used by 
+	// LoadSnapshot
+	static bool Snapshot_worker(cjson* Root, const char* Begin, const char* End);
+
+	// member array and key table of a frozen ARRAY or OBJECT
+	struct FrozenIndex;
+	FrozenIndex* frozenIndex();
+	void Freeze_worker();
+
+	// bits in nodeFlags
+	enum nodeFlags_e
+	{
+		HASH_VALID = 1,
+		HASH_UNORDERED = 2,
+		CACHE_CLEAN = 4, // unchanged since the last cached Stringify
+		CACHE_VALID = 8,
+		MEMOIZED = HASH_VALID | HASH_UNORDERED | CACHE_CLEAN | CACHE_VALID,
+		FROZEN = 16 // see Freeze, never cleared
+	};
+
+	// clear memoized values (hash, nodeCache) for this node and it's parents
+	void changed();
+
+	// true for nodes that can't be modified (mapped snapshots and 
+	// frozen documents)
+	bool readOnly() { return !mem || (nodeFlags & FROZEN); }
+
+	// the documents root node (rootNode is NULL for the root itself)
+	cjson* root() { return (rootNode) ? rootNode.get() : this; }
 
 	// helper used to find the index of current node in a members list
 	int getIndex();
@@ -459,4 +1723,696 @@ private:
 };
 
 
+
+/*
+-------------------------------------------------------------------------
+cjson::Reader implementation
+
+Reader is a template so the Handler calls can be inlined, as such
+it must live in the header.
+-------------------------------------------------------------------------
+*/
+
+template <typename Handler>
+cjson::Reader<Handler>::Reader(Handler& handler, bool ValidateUTF8) :
+	handler(handler),
+	validateUtf8(ValidateUTF8),
+	state(VALUE),
+	position(0)
+{
+}
+
+template <typename Handler>
+bool cjson::Reader<Handler>::done()
+{
+	return state == DONE;
+}
+
+template <typename Handler>
+bool cjson::Reader<Handler>::failed()
+{
+	return state == FAILED;
+}
+
+template <typename Handler>
+size_t cjson::Reader<Handler>::errorOffset()
+{
+	return position;
+}
+
+template <typename Handler>
+void cjson::Reader<Handler>::afterValue()
+{
+	state = (stack.empty()) ? DONE : COMMA_OR_CLOSE;
+}
+
+template <typename Handler>
+size_t cjson::Reader<Handler>::scan(const char* JSON, size_t Length, bool More)
+{
+	const char* cursor = JSON;
+	const char* end = JSON + Length;
+	const char* start;
+	const char* text;
+	size_t textLength;
+	bool escaped;
+	const char* word;
+	size_t wordLength;
+	int64_t Int;
+	double Dbl;
+	bool lenient = cjson::Lenient(&handler);
+	bool terminates = cjson::Terminates(&handler);
+
+	if (state == FAILED)
+		return 0;
+
+	while (cursor < end)
+	{
+		// lenient, a value or key right after a value has a comma missing
+		if (lenient && state == COMMA_OR_CLOSE && *cursor != ',' && *cursor != '}' && *cursor != ']' && 
+			*cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+			state = (stack.top()) ? KEY : VALUE;
+
+		switch (*cursor)
+		{
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			++cursor;
+			break;
+
+		case '{':
+			if ((state != VALUE && state != VALUE_OR_CLOSE) || !handler.onStartObject())
+				goto fail;
+			stack.push(true);
+			state = KEY_OR_CLOSE;
+			++cursor;
+			break;
+
+		case '[':
+			if ((state != VALUE && state != VALUE_OR_CLOSE) || !handler.onStartArray())
+				goto fail;
+			stack.push(false);
+			state = VALUE_OR_CLOSE;
+			++cursor;
+			break;
+
+		case '}':
+			if ((state != KEY_OR_CLOSE && state != COMMA_OR_CLOSE && !(lenient && state == KEY)) || 
+				!stack.top() || !handler.onEndObject())
+				goto fail;
+			stack.pop();
+			afterValue();
+			++cursor;
+			break;
+
+		case ']':
+			if ((state != VALUE_OR_CLOSE && state != COMMA_OR_CLOSE && !(lenient && state == VALUE && !stack.empty())) || 
+				stack.top() || !handler.onEndArray())
+				goto fail;
+			stack.pop();
+			afterValue();
+			++cursor;
+			break;
+
+		case ',':
+			if (state != COMMA_OR_CLOSE)
+				goto fail;
+			state = (stack.top()) ? KEY : VALUE;
+			++cursor;
+			break;
+
+		case ':':
+			if (state != COLON)
+				goto fail;
+			state = VALUE;
+			++cursor;
+			break;
+
+		case '"':
+			start = cursor + 1;
+			cursor = cjson::ScanQuote(start, end, escaped, validateUtf8);
+
+			if (cursor == end)
+			{
+				cursor = start - 1;
+				if (More)
+					goto stop;
+				goto fail;
+			}
+
+			// control characters must be escaped (or invalid UTF-8)
+			if (*cursor != '"')
+				goto fail;
+
+			text = start;
+			textLength = cursor - start;
+
+			// escaped strings are decoded into scratch, clean strings
+			// are passed straight from the JSON buffer
+			if (escaped && !cjson::Decodes(&handler))
+			{
+				if (!cjson::ValidEscapes(start, textLength))
+				{
+					cursor = start - 1;
+					goto fail;
+				}
+			}
+			else if (escaped)
+			{
+				scratch.resize(textLength);
+
+				if (!cjson::Unescape(start, cursor - start, &scratch[0], textLength) ||
+					(terminates && memchr(scratch.data(), 0, textLength)))
+				{
+					cursor = start - 1;
+					goto fail;
+				}
+
+				text = scratch.data();
+			}
+
+			if (state == KEY || state == KEY_OR_CLOSE)
+			{
+				if (!handler.onKey(text, textLength))
+					goto fail;
+				state = COLON;
+			}
+			else if (state == VALUE || state == VALUE_OR_CLOSE)
+			{
+				if (!handler.onString(text, textLength))
+					goto fail;
+				afterValue();
+			}
+			else
+			{
+				cursor = start - 1;
+				goto fail;
+			}
+
+			++cursor;
+			break;
+
+		case '-':
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (state != VALUE && state != VALUE_OR_CLOSE)
+				goto fail;
+
+			start = cursor;
+
+			while (cursor < end &&
+				((*cursor >= '0' && *cursor <= '9') ||
+				*cursor == '-' || *cursor == '+' || *cursor == '.' ||
+				*cursor == 'e' || *cursor == 'E'))
+				++cursor;
+
+			if (cursor == end && More)
+			{
+				cursor = start;
+				goto stop;
+			}
+
+			switch (cjson::ParseNumber(start, cursor, Int, Dbl, cjson::Decodes(&handler)))
+			{
+			case 1:
+				if (!handler.onInt(Int))
+					goto fail;
+				break;
+			case 2:
+				if (!handler.onDouble(Dbl))
+					goto fail;
+				break;
+			default:
+				cursor = start;
+				goto fail;
+			}
+
+			afterValue();
+			break;
+
+		case 'T':
+		case 'F':
+		case 'N':
+		case 'u':
+		case 'U':
+			if (!lenient)
+				goto fail;
+			// fall through
+		case 't':
+		case 'f':
+		case 'n':
+			if (state != VALUE && state != VALUE_OR_CLOSE)
+				goto fail;
+
+			switch (*cursor | 0x20)
+			{
+			case 't':
+				word = "true";
+				break;
+			case 'f':
+				word = "false";
+				break;
+			case 'n':
+				word = "null";
+				break;
+			default:
+				word = "undefined";
+			}
+
+			wordLength = strlen(word);
+
+			if ((size_t)(end - cursor) < wordLength)
+			{
+				if (More && memcmp(cursor, word, end - cursor) == 0)
+					goto stop;
+				goto fail;
+			}
+
+			if (!lenient && memcmp(cursor, word, wordLength) != 0)
+				goto fail;
+
+			if (lenient)
+				for (size_t i = 0; i < wordLength; i++)
+					if ((cursor[i] | 0x20) != word[i])
+						goto fail;
+
+			if (*word == 'u')
+			{
+				if (!cjson::Undefined(&handler))
+					goto fail;
+			}
+			else if (*word == 'n')
+			{
+				if (!handler.onNull())
+					goto fail;
+			}
+			else if (!handler.onBool(*word == 't'))
+				goto fail;
+
+			cursor += wordLength;
+			afterValue();
+			break;
+
+		default:
+			goto fail;
+		}
+	}
+
+stop:
+	position += cursor - JSON;
+	return cursor - JSON;
+
+fail:
+	state = FAILED;
+	position += cursor - JSON;
+	return cursor - JSON;
+}
+
+template <typename Handler>
+bool cjson::ParseEvents(const char* JSON, size_t Length, Handler& handler, size_t* errorOffset, bool ValidateUTF8)
+{
+	Reader< Handler > reader(handler, ValidateUTF8);
+
+	reader.scan(JSON, Length, false);
+
+	if (errorOffset)
+		*errorOffset = reader.errorOffset();
+
+	return reader.done();
+}
+
+/*
+-------------------------------------------------------------------------
+cjson::Builder - inline so Reader< Builder > can inline the handler
+-------------------------------------------------------------------------
+*/
+
+inline cjson::Builder::Builder() :
+	root(NULL),
+	current(NULL),
+	pendingName(NULL),
+	pendingHash(0),
+	lenient(false)
+{
+}
+
+inline bool cjson::Lenient(Builder* builder)
+{
+	return builder->lenient;
+}
+
+// the unchecked Parse keeps the text up to the NULL, as the original 
+// parser did
+inline bool cjson::Terminates(Builder* builder)
+{
+	return !builder->lenient;
+}
+
+// the member is left out, as the original parser did
+inline bool cjson::Undefined(Builder* builder)
+{
+	builder->pendingName = NULL;
+	return true;
+}
+
+// create a node of Type in the current container using the pending
+// name (if any). Names and values are written straight into the 
+// HeapStack so parsing doesn't make temporary copies.
+inline cjson* cjson::Builder::add(cjsonType Type, size_t DataSize)
+{
+	cjson* node = (DataSize) ? current->createValueNode(Type, DataSize) : current->createNode();
+	CJSON_COUNT(parseNodes, 1);
+	node->nodeType = Type;
+	node->nodeName = pendingName;
+	current->Link(node);
+
+	if (pendingName)
+		keys.push_back(std::make_pair(pendingHash, node));
+
+	pendingName = NULL;
+	return node;
+}
+
+inline bool cjson::Builder::container(cjsonType Type)
+{
+	if (!current)
+	{
+		// only one top level value
+		if (root)
+			return false;
+
+		root = cjson::MakeDocument();
+		root->setType(Type);
+		current = root;
+		CJSON_COUNT(parseNodes, 1);
+	}
+	else
+		current = add(Type);
+
+	if (Type == cjsonType::OBJECT)
+		keyMarks.push_back(keys.size());
+
+	return true;
+}
+
+inline bool cjson::Builder::onStartObject()
+{
+	return container(cjsonType::OBJECT);
+}
+
+inline bool cjson::Builder::onEndObject()
+{
+	size_t first = keyMarks.back();
+	keyMarks.pop_back();
+
+	if (keys.size() - first > 1)
+		dedupe(current, first);
+
+	keys.resize(first);
+
+	current = current->parentNode;
+	return true;
+}
+
+inline bool cjson::Builder::onStartArray()
+{
+	return container(cjsonType::ARRAY);
+}
+
+inline bool cjson::Builder::onEndArray()
+{
+	current = current->parentNode;
+	return true;
+}
+
+inline bool cjson::Builder::onKey(const char* Text, size_t Length)
+{
+	pendingName = current->mem->newPtr(Length + 1);
+	memcpy(pendingName, Text, Length);
+	pendingName[Length] = 0;
+	pendingHash = KeyHash(Text, Length);
+	return true;
+}
+
+inline bool cjson::Builder::onString(const char* Text, size_t Length)
+{
+	// top level values other than arrays and objects are ignored
+	if (!current)
+		return true;
+
+	cjson* node = add(cjsonType::STR, Length + 1);
+	char* textPtr = &node->nodeData->asStr;
+	memcpy(textPtr, Text, Length);
+	textPtr[Length] = 0;
+	return true;
+}
+
+inline bool cjson::Builder::onInt(int64_t Value)
+{
+	if (current)
+		add(cjsonType::INT, sizeof(int64_t))->nodeData->asInt = Value;
+	return true;
+}
+
+inline bool cjson::Builder::onDouble(double Value)
+{
+	if (current)
+		add(cjsonType::DBL, sizeof(double))->nodeData->asDouble = Value;
+	return true;
+}
+
+inline bool cjson::Builder::onBool(bool Value)
+{
+	if (current)
+		add(cjsonType::BOOL, sizeof(bool))->nodeData->asBool = Value;
+	return true;
+}
+
+inline bool cjson::Builder::onNull()
+{
+	if (current)
+		add(cjsonType::NUL);
+	return true;
+}
+
+
+/*
+-------------------------------------------------------------------------
+Typed binding implementation
+-------------------------------------------------------------------------
+*/
+
+// CJSON_BIND(Type, fields...) declares the JSON keys of Type, each field 
+// is CJSON_FIELD(member) or CJSON_FIELD_AS("key", member)
+#define CJSON_BIND(Type, ...) \
+	inline const cjson::BindTable& cjsonBindTable(const Type*) \
+	{ \
+		typedef Type BoundType; \
+		static const cjson::BindField fields[] = { __VA_ARGS__ }; \
+		static const cjson::BindTable table(fields, sizeof(fields) / sizeof(fields[0])); \
+		return table; \
+	}
+
+#define CJSON_FIELD_AS(Key, Member) \
+	cjson::BindField(Key, \
+		&cjson::BindAccess< BoundType, decltype(BoundType::Member), &BoundType::Member >::read, \
+		&cjson::BindAccess< BoundType, decltype(BoundType::Member), &BoundType::Member >::write)
+
+#define CJSON_FIELD(Member) CJSON_FIELD_AS(#Member, Member)
+
+// bound structs, cjsonBindTable is found by argument dependent lookup
+// (it's declared by CJSON_BIND)
+template <typename M>
+struct cjson::BindValue
+{
+	static bool read(BindReader& reader, M& Value)
+	{
+		return reader.object(cjsonBindTable((const M*)NULL), &Value);
+	}
+
+	static void write(Writer& writer, const M& Value)
+	{
+		cjson::BindWriteObject(writer, cjsonBindTable((const M*)NULL), &Value);
+	}
+};
+
+template <>
+struct cjson::BindValue< int64_t >
+{
+	static bool read(BindReader& reader, int64_t& Value) { return reader.integer(Value); }
+	static void write(Writer& writer, const int64_t& Value) { writer.value(Value); }
+};
+
+template <>
+struct cjson::BindValue< int >
+{
+	static bool read(BindReader& reader, int& Value)
+	{
+		int64_t wide;
+
+		if (!reader.integer(wide) || wide < INT32_MIN || wide > INT32_MAX)
+			return false;
+
+		Value = (int)wide;
+		return true;
+	}
+
+	static void write(Writer& writer, const int& Value) { writer.value((int64_t)Value); }
+};
+
+template <>
+struct cjson::BindValue< double >
+{
+	static bool read(BindReader& reader, double& Value) { return reader.real(Value); }
+	static void write(Writer& writer, const double& Value) { writer.value(Value); }
+};
+
+template <>
+struct cjson::BindValue< float >
+{
+	static bool read(BindReader& reader, float& Value)
+	{
+		double wide;
+
+		if (!reader.real(wide))
+			return false;
+
+		Value = (float)wide;
+		return true;
+	}
+
+	static void write(Writer& writer, const float& Value) { writer.value((double)Value); }
+};
+
+template <>
+struct cjson::BindValue< bool >
+{
+	static bool read(BindReader& reader, bool& Value) { return reader.boolean(Value); }
+	static void write(Writer& writer, const bool& Value) { writer.value(Value); }
+};
+
+template <>
+struct cjson::BindValue< std::string >
+{
+	static bool read(BindReader& reader, std::string& Value) { return reader.string(Value); }
+	static void write(Writer& writer, const std::string& Value) { writer.value(Value); }
+};
+
+template <typename E>
+struct cjson::BindValue< std::vector< E > >
+{
+	static bool read(BindReader& reader, std::vector< E >& Value)
+	{
+		bool empty;
+
+		Value.clear();
+
+		if (!reader.beginArray(empty))
+			return false;
+
+		bool more = !empty;
+
+		while (more)
+		{
+			Value.emplace_back();
+
+			if (!BindValue< E >::read(reader, Value.back()) || !reader.arrayNext(more))
+				return false;
+		}
+
+		return true;
+	}
+
+	static void write(Writer& writer, const std::vector< E >& Value)
+	{
+		writer.beginArray();
+
+		for (size_t i = 0; i < Value.size(); i++)
+			BindValue< E >::write(writer, Value[i]);
+
+		writer.endArray();
+	}
+};
+
+// std::vector< bool > packs it's elements, so they are read into a bool
+// and pushed rather than read in place
+template <>
+struct cjson::BindValue< std::vector< bool > >
+{
+	static bool read(BindReader& reader, std::vector< bool >& Value)
+	{
+		bool empty;
+
+		Value.clear();
+
+		if (!reader.beginArray(empty))
+			return false;
+
+		bool more = !empty;
+
+		while (more)
+		{
+			bool element;
+
+			if (!reader.boolean(element) || !reader.arrayNext(more))
+				return false;
+
+			Value.push_back(element);
+		}
+
+		return true;
+	}
+
+	static void write(Writer& writer, const std::vector< bool >& Value)
+	{
+		writer.beginArray();
+
+		for (size_t i = 0; i < Value.size(); i++)
+			writer.value((bool)Value[i]);
+
+		writer.endArray();
+	}
+};
+
+template <typename T>
+bool cjson::ParseInto(const char* JSON, size_t Length, T& Object, size_t* ErrorOffset)
+{
+	BindReader reader(JSON, Length);
+	bool result = BindValue< T >::read(reader, Object) && reader.finish();
+
+	if (ErrorOffset)
+		*ErrorOffset = reader.offset();
+
+	return result;
+}
+
+template <typename T>
+bool cjson::ParseInto(const std::string& JSON, T& Object, size_t* ErrorOffset)
+{
+	return ParseInto(JSON.c_str(), JSON.length(), Object, ErrorOffset);
+}
+
+template <typename T>
+std::string cjson::StringifyFrom(const T& Object, const StringifyOptions& Options)
+{
+	std::string out;
+
+	{
+		// the Writer flushes when it goes out of scope
+		Writer writer(out, Options);
+		BindValue< T >::write(writer, Object);
+	}
+
+	return out;
+}
+
 #endif CJSON_H
\ No newline at end of file